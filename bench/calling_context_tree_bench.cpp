@@ -0,0 +1,172 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares trace::CallingContextTree against the nested std::map of children per node that it
+// replaced, in insert throughput and memory usage, on synthetic call chains. The memory of the
+// std::map tree is the growth of the heap, the one of CallingContextTree is its memory_usage().
+//
+// Usage: lo2s-bench-calling-context-tree [DISTINCT_CHAINS [INSERTIONS]]
+
+#include <lo2s/address.hpp>
+#include <lo2s/trace/calling_context_tree.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+extern "C"
+{
+#include <malloc.h>
+}
+
+namespace
+{
+using lo2s::Address;
+using Chain = std::vector<uint64_t>;
+
+// The former per-node representation
+struct MapEntry
+{
+    MapEntry(uint32_t r) : ref(r)
+    {
+    }
+
+    uint32_t ref;
+    std::map<Address, MapEntry> children;
+};
+
+// Chains of 5 to 60 frames through a fixed set of functions. Chains starting in the same function
+// share their whole prefix, only the innermost frame varies, like samples of a few hot loops.
+std::vector<Chain> make_chains(std::size_t count)
+{
+    std::mt19937_64 rng(42);
+
+    std::vector<uint64_t> functions(3000);
+    for (auto& function : functions)
+    {
+        function = 0x400000 + rng() % 100000000;
+    }
+
+    std::vector<Chain> chains(count);
+    for (auto& chain : chains)
+    {
+        std::size_t depth = 5 + rng() % 56;
+        std::size_t start = rng() % 50;
+        for (std::size_t level = 0; level + 1 < depth; level++)
+        {
+            chain.push_back(functions[(start * 31 + level * 7) % functions.size()]);
+        }
+        chain.push_back(functions[(start * 31 + (depth - 1) * 7 + rng() % 200) % functions.size()] +
+                        rng() % 512);
+    }
+    return chains;
+}
+
+// Bytes currently in use on the heap
+std::size_t heap_usage()
+{
+    return mallinfo2().uordblks;
+}
+
+template <class Insert>
+double measure(const std::vector<Chain>& chains, std::size_t insertions, Insert insert,
+               std::size_t& edges)
+{
+    std::mt19937_64 rng(23);
+    edges = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < insertions; i++)
+    {
+        const auto& chain = chains[rng() % chains.size()];
+        insert(chain);
+        edges += chain.size();
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - begin;
+    return duration.count();
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t distinct = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 400000;
+    std::size_t insertions = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000000;
+
+    auto chains = make_chains(distinct);
+    std::size_t edges;
+
+    {
+        std::size_t before = heap_usage();
+        MapEntry root(0);
+        uint32_t next_ref = 1;
+
+        double seconds = measure(
+            chains, insertions,
+            [&](const Chain& chain) {
+                MapEntry* node = &root;
+                for (auto ip : chain)
+                {
+                    auto res = node->children.try_emplace(Address(ip), next_ref);
+                    if (res.second)
+                    {
+                        next_ref++;
+                    }
+                    node = &res.first->second;
+                }
+            },
+            edges);
+
+        std::cout << "std::map:           " << edges / seconds / 1e6 << "M edge inserts/s, "
+                  << (heap_usage() - before) / 1e6 << " MB, " << next_ref - 1 << " nodes"
+                  << std::endl;
+    }
+
+    {
+        lo2s::trace::CallingContextTree<uint32_t> tree(0);
+        uint32_t next_ref = 1;
+
+        double seconds = measure(
+            chains, insertions,
+            [&](const Chain& chain) {
+                auto node = tree.ROOT;
+                for (auto ip : chain)
+                {
+                    auto res = tree.emplace(node, Address(ip), next_ref);
+                    if (res.second)
+                    {
+                        next_ref++;
+                    }
+                    node = res.first;
+                }
+            },
+            edges);
+
+        std::cout << "CallingContextTree: " << edges / seconds / 1e6 << "M edge inserts/s, "
+                  << tree.memory_usage() / 1e6 << " MB, " << tree.size() - 1 << " nodes"
+                  << std::endl;
+    }
+
+    return 0;
+}
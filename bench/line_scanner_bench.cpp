@@ -0,0 +1,294 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the parsers of the /proc and /sys files read at startup against the std::regex based
+// versions they replaced: /proc/kallsyms, /proc/<pid>/maps and the tracepoint format files.
+//
+// Usage: lo2s-bench-line-scanner [REPETITIONS]
+
+#include <lo2s/line_scanner.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+using namespace lo2s;
+
+std::size_t kallsyms_regex(const std::string& filename)
+{
+    std::ifstream ksyms_file(filename);
+    std::regex ksym_regex("([0-9a-f]+) (?:t|T) ([^[:space:]]+)");
+    std::smatch ksym_match;
+    std::size_t count = 0;
+
+    std::string line;
+    while (getline(ksyms_file, line))
+    {
+        if (std::regex_match(line, ksym_match, ksym_regex))
+        {
+            uint64_t sym_addr = stoull(ksym_match[1], nullptr, 16);
+            if (sym_addr != 0)
+            {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+std::size_t kallsyms_scanner(const std::string& filename)
+{
+    LineScanner ksyms_file(filename);
+    std::size_t count = 0;
+
+    std::string_view line;
+    while (ksyms_file.next(line))
+    {
+        uint64_t sym_addr;
+        if (!scan::hex(line, sym_addr))
+        {
+            continue;
+        }
+        auto type = scan::field(line);
+        auto name = scan::field(line);
+        scan::skip_spaces(line);
+        if ((type == "t" || type == "T") && !name.empty() && line.empty() && sym_addr != 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::size_t maps_regex(const std::string& filename)
+{
+    std::ifstream mapstream(filename);
+    std::regex regex("([0-9a-f]+)\\-([0-9a-f]+)\\s+[r-][w-]x.?\\s+([0-9a-z]+)"
+                     "\\s+\\S+\\s+\\d+\\s+(.*)");
+    std::size_t count = 0;
+
+    std::string line;
+    while (getline(mapstream, line))
+    {
+        std::smatch match;
+        if (std::regex_match(line, match, regex))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::size_t maps_scanner(const std::string& filename)
+{
+    LineScanner mapstream(filename);
+    std::size_t count = 0;
+
+    std::string_view line;
+    while (mapstream.next(line))
+    {
+        uint64_t start, end, offset;
+        if (!scan::hex(line, start) || !scan::consume(line, '-') || !scan::hex(line, end))
+        {
+            continue;
+        }
+        auto prot = scan::field(line);
+        if (prot.size() < 3 || prot[2] != 'x')
+        {
+            continue;
+        }
+        scan::skip_spaces(line);
+        if (!scan::hex(line, offset))
+        {
+            continue;
+        }
+        count++;
+    }
+    return count;
+}
+
+std::size_t format_regex(const std::string& filename)
+{
+    static std::regex field_regex(
+        "^\\s+field:([^;]+);\\s+offset:(\\d+);\\s+size:(\\d+);\\s+signed:(\\d+);$");
+    static std::regex type_name_regex("^(.*) ([^ \\[\\]]+)(\\[[^\\]]+\\])?$");
+
+    std::ifstream ifs_format(filename);
+    std::size_t count = 0;
+
+    std::string line;
+    while (std::getline(ifs_format, line))
+    {
+        std::smatch field_match;
+        if (!std::regex_match(line, field_match, field_regex))
+        {
+            continue;
+        }
+
+        std::string param = field_match[1];
+        std::smatch type_name_match;
+        if (std::regex_match(param, type_name_match, type_name_regex))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::size_t format_scanner(const std::string& filename)
+{
+    LineScanner format(filename);
+    std::size_t count = 0;
+
+    std::string_view line;
+    while (format.next(line))
+    {
+        auto rest = line;
+        uint64_t offset, size, is_signed;
+        std::string_view param;
+
+        scan::skip_spaces(rest);
+        bool is_field = rest.size() < line.size() && scan::consume(rest, "field:");
+        if (is_field)
+        {
+            auto param_end = rest.find(';');
+            is_field = param_end != std::string_view::npos;
+            if (is_field)
+            {
+                param = rest.substr(0, param_end);
+                rest.remove_prefix(param_end + 1);
+            }
+        }
+        auto number_field = [&rest](std::string_view key, uint64_t& value) {
+            scan::skip_spaces(rest);
+            return scan::consume(rest, key) && scan::number(rest, value) &&
+                   scan::consume(rest, ';');
+        };
+        if (!is_field || !number_field("offset:", offset) || !number_field("size:", size) ||
+            !number_field("signed:", is_signed) || !rest.empty())
+        {
+            continue;
+        }
+
+        auto name_begin = param.rfind(' ');
+        std::string_view name;
+        if (name_begin != std::string_view::npos)
+        {
+            name = param.substr(name_begin + 1);
+            if (!name.empty() && name.back() == ']')
+            {
+                name = name.substr(0, name.find('['));
+            }
+        }
+        if (!name.empty() && name.find_first_of("[]") == std::string_view::npos)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::vector<std::string> maps_files()
+{
+    std::vector<std::string> files;
+    for (const auto& entry : std::filesystem::directory_iterator("/proc"))
+    {
+        auto name = entry.path().filename().string();
+        if (name.find_first_not_of("0123456789") == std::string::npos)
+        {
+            files.emplace_back(entry.path() / "maps");
+        }
+    }
+    return files;
+}
+
+std::vector<std::string> format_files()
+{
+    std::vector<std::string> files;
+    for (const char* base : { "/sys/kernel/tracing/events", "/sys/kernel/debug/tracing/events" })
+    {
+        std::error_code ec;
+        for (std::filesystem::recursive_directory_iterator it(base, ec), end; !ec && it != end;
+             it.increment(ec))
+        {
+            if (it->path().filename() == "format" && it.depth() == 2)
+            {
+                files.emplace_back(it->path());
+            }
+        }
+        if (!files.empty())
+        {
+            break;
+        }
+    }
+    return files;
+}
+
+template <class Parser>
+void run(const char* name, const std::vector<std::string>& files, Parser parser, int repetitions)
+{
+    std::size_t entries = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++)
+    {
+        entries = 0;
+        for (const auto& file : files)
+        {
+            entries += parser(file);
+        }
+    }
+    std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - begin;
+
+    std::cout << name << ": " << files.size() << " files, " << entries << " entries, "
+              << duration.count() / repetitions << " ms" << std::endl;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int repetitions = argc > 1 ? std::atoi(argv[1]) : 5;
+
+    std::vector<std::string> kallsyms = { "/proc/kallsyms" };
+    auto maps = maps_files();
+    auto formats = format_files();
+    if (formats.empty())
+    {
+        std::cout << "tracefs is not readable, skipping the tracepoint format files" << std::endl;
+    }
+
+    run("kallsyms regex  ", kallsyms, kallsyms_regex, repetitions);
+    run("kallsyms scanner", kallsyms, kallsyms_scanner, repetitions);
+    run("maps regex      ", maps, maps_regex, repetitions);
+    run("maps scanner    ", maps, maps_scanner, repetitions);
+    run("format regex    ", formats, format_regex, repetitions);
+    run("format scanner  ", formats, format_scanner, repetitions);
+
+    return 0;
+}
@@ -29,6 +29,7 @@
 #include <mutex>
 #include <regex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 using std::hex;
@@ -147,6 +148,23 @@ public:
     }
 
 private:
+    // A function symbol, with the address range as file offsets
+    struct Function
+    {
+        Address start;
+        Address end;
+        asection* section;
+        // interned and already demangled
+        const std::string* name;
+    };
+
+    const Function& lookup_function(Address addr) const;
+
+    const std::string* intern(const std::string& str)
+    {
+        return &*strings_.emplace(str).first;
+    }
+
     void filter_symbols()
     {
         symbols_.erase(std::remove_if(symbols_.begin(), symbols_.end(), [](const asymbol* sym) {
@@ -156,7 +174,7 @@ private:
 
     void read_symbols();
 
-    void read_sections();
+    void read_functions();
 
     template <typename T>
     static T check_symtab(T sz)
@@ -171,7 +189,12 @@ private:
     std::string name_;
     unique_bfd_ptr handle_;
     std::vector<asymbol*> symbols_;
-    std::map<Range, asection*> sections_;
+    // sorted by start address, built once so that lookups are a binary search
+    std::vector<Function> functions_;
+    std::unordered_set<std::string> strings_;
+    // Without DWARF line information, neither in the binary nor in a separate debug file,
+    // bfd_find_nearest_line would only walk the symbol table
+    bool has_line_info_;
 
     static Initializer dummy_;
 };
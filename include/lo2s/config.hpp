@@ -53,6 +53,7 @@ struct Config
     std::string command_line;
     bool quiet;
     bool drop_root;
+    bool use_ptrace;
     std::string user = "";
     // Optional features
     std::vector<std::string> tracepoint_events;
@@ -65,6 +66,11 @@ struct Config
     std::string trace_path;
     // perf
     std::size_t mmap_pages;
+    std::size_t perf_read_chunk_pages;
+    bool shared_perf_buffer;
+    // 0 if every monitored thread gets its own monitoring thread
+    std::size_t reader_pool_size;
+    bool per_cpu_inherit;
     bool exclude_kernel;
     // Instruction sampling
     bool sampling;
@@ -73,15 +79,27 @@ struct Config
     bool enable_cct;
     bool suppress_ip;
     bool disassemble;
+    bool defer_symbols;
+    // 0 if calling contexts are only merged at the end of the measurement
+    std::chrono::nanoseconds cctx_merge_interval = std::chrono::nanoseconds(0);
+    // empty if the symbol cache is disabled
+    std::string symbol_cache_dir;
     // Interval monitors
     std::chrono::nanoseconds read_interval;
     std::chrono::nanoseconds userspace_read_interval;
     std::chrono::nanoseconds perf_read_interval = std::chrono::nanoseconds(0);
+    // Flight recorder
+    bool flight_recorder;
+    std::string flight_recorder_trigger_file;
     // Metrics
     bool metric_use_frequency;
 
     std::uint64_t metric_count;
     std::uint64_t metric_frequency;
+    // Suppression of unchanged metric events, disabled if the keyframe interval is 0
+    std::uint64_t metric_keyframe_interval = 0;
+    double metric_suppression_relative = 0;
+    double metric_suppression_absolute = 0;
 
     // time synchronization
     bool use_clockid;
@@ -91,6 +109,8 @@ struct Config
     bool use_x86_energy;
     // block I/O
     bool use_block_io;
+    std::chrono::nanoseconds block_io_reorder_window;
+    bool block_io_histogram;
     // syscalls
     bool use_syscalls = false;
     std::vector<int64_t> syscall_filter;
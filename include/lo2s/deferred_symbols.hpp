@@ -0,0 +1,80 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/address.hpp>
+#include <lo2s/line_info.hpp>
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace lo2s
+{
+
+/**
+ * Symbols of user space binaries that are resolved after the measurement by lo2s-resolve.
+ *
+ * With --defer-symbols, every distinct (binary, file offset) pair gets its own region and
+ * source code location in the trace. Their strings are unique placeholders, which lo2s-resolve
+ * replaces by the resolved function and file names. The pairs themselves are written to a
+ * sidecar file in the trace directory.
+ */
+class DeferredSymbols
+{
+public:
+    struct Binary
+    {
+        std::string path;
+        // empty if the binary has no build-id
+        std::string build_id;
+        std::set<Address> offsets;
+    };
+
+    static constexpr const char* SIDECAR_FILENAME = "lo2s-symbols.txt";
+
+    static DeferredSymbols& instance()
+    {
+        static DeferredSymbols symbols;
+        return symbols;
+    }
+
+    // Records the pair and returns the placeholder line info for it
+    LineInfo add(const std::string& binary, Address offset);
+
+    void write(const std::filesystem::path& trace_dir);
+
+    static std::vector<Binary> read(const std::filesystem::path& trace_dir);
+
+    static std::string function_placeholder(const std::string& binary, Address offset);
+    static std::string file_placeholder(const std::string& binary, Address offset);
+
+private:
+    DeferredSymbols() = default;
+
+    std::mutex mutex_;
+    std::map<std::string, std::set<Address>> binaries_;
+};
+} // namespace lo2s
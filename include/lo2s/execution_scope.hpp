@@ -22,6 +22,7 @@
 
 #include <cassert>
 #include <map>
+#include <mutex>
 
 #include <fmt/core.h>
 
@@ -156,6 +157,7 @@ public:
 
     bool is_group(const ExecutionScope& scope) const
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         const auto& it = groups_.find(scope);
         if (it == groups_.end())
         {
@@ -171,6 +173,7 @@ public:
 
     ExecutionScope get_parent(const ExecutionScope& scope) const
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         return groups_.at(scope);
     }
 
@@ -178,6 +181,7 @@ public:
     {
         // If we don't know the parent process by the time we get to know the child thread, we will
         // never know it, so just report pid 0
+        std::lock_guard<std::mutex> guard(mutex_);
         if (groups_.count(thread.as_scope()) == 0)
         {
             return Process(0);
@@ -187,17 +191,20 @@ public:
 
     void add_process(Process process)
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         groups_.emplace(process.as_thread().as_scope(), process.as_scope());
     }
 
     void add_thread(Thread thread, Process process)
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         groups_.emplace(thread.as_scope(), process.as_scope());
     }
 
     // If we only know the parent thread, try to find the parent process.
     void add_thread(Thread child, Thread parent)
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         const auto& real_parent = groups_.find(parent.as_scope());
         if (real_parent == groups_.end())
         {
@@ -215,6 +222,7 @@ public:
 
     void add_cpu(Cpu cpu)
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         groups_.emplace(cpu.as_scope(), cpu.as_scope());
     }
 
@@ -227,6 +235,8 @@ private:
     {
     }
 
+    // The system-wide monitor fills this in from several threads while recording
+    mutable std::mutex mutex_;
     std::map<ExecutionScope, ExecutionScope> groups_;
 };
 
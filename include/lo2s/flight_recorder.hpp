@@ -0,0 +1,68 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace lo2s
+{
+
+// Decides when the contents of the overwritable perf buffers are written to the trace if lo2s
+// runs in flight recorder mode (--flight-recorder).
+//
+// A dump is triggered by sending SIGUSR1 to lo2s, by creating the trigger file given with
+// --flight-recorder-trigger-file, or from within lo2s by calling trigger(). Every trigger
+// increments the generation, monitors dump their buffers whenever the generation changed since
+// they last looked at it.
+class FlightRecorder
+{
+public:
+    static FlightRecorder& instance()
+    {
+        static FlightRecorder fr;
+        return fr;
+    }
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    void trigger();
+
+    std::uint64_t generation();
+
+private:
+    FlightRecorder();
+
+    void check_trigger_file();
+
+    static void signal_handler(int);
+
+    // Written from the signal handler, so this has to be a lock-free atomic and not a member
+    static std::atomic<std::uint64_t> generation_;
+
+    std::mutex trigger_file_mutex_;
+    std::chrono::steady_clock::time_point last_trigger_file_check_;
+};
+} // namespace lo2s
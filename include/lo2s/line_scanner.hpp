@@ -0,0 +1,195 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <cstdint>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+namespace lo2s
+{
+
+/**
+ * Reads a whole file at once and splits it into lines.
+ *
+ * Meant for the large text files in /proc and /sys that are parsed at startup. Apart from the
+ * buffer of the file contents, nothing is allocated: lines and fields are string_views into the
+ * buffer, and the functions in namespace scan parse them by hand instead of with
+ * std::regex.
+ */
+class LineScanner
+{
+public:
+    LineScanner(const std::string& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return;
+        }
+
+        // Files in procfs report a size of 0, so read until EOF
+        std::size_t size = 0;
+        buffer_.resize(64 * 1024);
+        while (true)
+        {
+            if (size == buffer_.size())
+            {
+                buffer_.resize(buffer_.size() * 2);
+            }
+            auto ret = ::read(fd, buffer_.data() + size, buffer_.size() - size);
+            if (ret <= 0)
+            {
+                ok_ = (ret == 0);
+                break;
+            }
+            size += ret;
+        }
+        ::close(fd);
+        buffer_.resize(size);
+    }
+
+    // false if the file could not be read
+    bool ok() const
+    {
+        return ok_;
+    }
+
+    // Stores the next line without the trailing newline in line, returns false at the end
+    bool next(std::string_view& line)
+    {
+        if (pos_ >= buffer_.size())
+        {
+            return false;
+        }
+
+        auto end = buffer_.find('\n', pos_);
+        if (end == std::string::npos)
+        {
+            end = buffer_.size();
+        }
+        line = std::string_view(buffer_).substr(pos_, end - pos_);
+        pos_ = end + 1;
+        return true;
+    }
+
+private:
+    std::string buffer_;
+    std::size_t pos_ = 0;
+    bool ok_ = false;
+};
+
+namespace scan
+{
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline void skip_spaces(std::string_view& str)
+{
+    while (!str.empty() && is_space(str.front()))
+    {
+        str.remove_prefix(1);
+    }
+}
+
+// Removes and returns everything up to the next space or tab, skipping leading spaces
+inline std::string_view field(std::string_view& str)
+{
+    skip_spaces(str);
+    std::size_t len = 0;
+    while (len < str.size() && !is_space(str[len]))
+    {
+        len++;
+    }
+    auto result = str.substr(0, len);
+    str.remove_prefix(len);
+    return result;
+}
+
+// Removes c from the front of str, if it is there
+inline bool consume(std::string_view& str, char c)
+{
+    if (str.empty() || str.front() != c)
+    {
+        return false;
+    }
+    str.remove_prefix(1);
+    return true;
+}
+
+// Removes prefix from the front of str, if it is there
+inline bool consume(std::string_view& str, std::string_view prefix)
+{
+    if (str.substr(0, prefix.size()) != prefix)
+    {
+        return false;
+    }
+    str.remove_prefix(prefix.size());
+    return true;
+}
+
+// Parses and removes the number at the front of str, returns false if there is none
+inline bool number(std::string_view& str, uint64_t& value, int base = 10)
+{
+    std::size_t len = 0;
+    value = 0;
+    for (; len < str.size(); len++)
+    {
+        char c = str[len];
+        int digit;
+        if (c >= '0' && c <= '9')
+        {
+            digit = c - '0';
+        }
+        else if (base == 16 && c >= 'a' && c <= 'f')
+        {
+            digit = c - 'a' + 10;
+        }
+        else if (base == 16 && c >= 'A' && c <= 'F')
+        {
+            digit = c - 'A' + 10;
+        }
+        else
+        {
+            break;
+        }
+        value = value * base + digit;
+    }
+    str.remove_prefix(len);
+    return len > 0;
+}
+
+inline bool hex(std::string_view& str, uint64_t& value)
+{
+    return number(str, value, 16);
+}
+} // namespace scan
+} // namespace lo2s
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <lo2s/metric/suppressor.hpp>
 #include <lo2s/monitor/poll_monitor.hpp>
 #include <lo2s/time/time.hpp>
 #include <lo2s/trace/fwd.hpp>
@@ -41,7 +42,7 @@ public:
     ~Recorder();
 
 protected:
-    void monitor(int fd) override;
+    void on_timer() override;
 
     std::string group() const override
     {
@@ -53,6 +54,7 @@ private:
 
     otf2::definition::metric_instance metric_instance_;
     std::unique_ptr<otf2::event::metric> event_;
+    metric::Suppressor suppressor_;
 
     std::vector<std::pair<const void*, int>> items_;
 };
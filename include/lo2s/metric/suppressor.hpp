@@ -0,0 +1,137 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/config.hpp>
+
+#include <otf2xx/event/metric.hpp>
+#include <otf2xx/writer/local.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace lo2s
+{
+namespace metric
+{
+// Drops metric events whose values all changed by less than the configured epsilons since the
+// last written event, e.g. the counters of idle CPUs. Every --metric-keyframe-interval events,
+// an event is written regardless.
+//
+// For each event, set() the values that shall be compared and then pass it to write().
+class Suppressor
+{
+public:
+    Suppressor(otf2::writer::local& writer)
+    : writer_(writer), keyframe_interval_(config().metric_keyframe_interval),
+      relative_epsilon_(config().metric_suppression_relative),
+      absolute_epsilon_(config().metric_suppression_absolute)
+    {
+    }
+
+    Suppressor(const Suppressor&) = delete;
+    Suppressor& operator=(const Suppressor&) = delete;
+
+    Suppressor(Suppressor&& other)
+    : writer_(other.writer_), keyframe_interval_(other.keyframe_interval_),
+      relative_epsilon_(other.relative_epsilon_), absolute_epsilon_(other.absolute_epsilon_),
+      current_(std::move(other.current_)), written_(std::move(other.written_)),
+      held_(std::move(other.held_)), suppressed_(other.suppressed_)
+    {
+        other.held_.reset();
+    }
+
+    ~Suppressor()
+    {
+        // The values stayed the same until the last dropped event
+        if (held_)
+        {
+            writer_.write(*held_);
+        }
+    }
+
+    void set(std::size_t index, double value)
+    {
+        if (index >= current_.size())
+        {
+            current_.resize(index + 1, 0);
+            written_.resize(index + 1, std::numeric_limits<double>::quiet_NaN());
+        }
+        current_[index] = value;
+    }
+
+    void write(const otf2::event::metric& event)
+    {
+        if (keyframe_interval_ == 0)
+        {
+            writer_.write(event);
+            return;
+        }
+
+        bool changed = false;
+        for (std::size_t i = 0; i < current_.size() && !changed; i++)
+        {
+            double epsilon = std::max(absolute_epsilon_, relative_epsilon_ * std::abs(written_[i]));
+            // also true if nothing has been written yet, as written_ is NaN then
+            changed = !(std::abs(current_[i] - written_[i]) <= epsilon);
+        }
+
+        if (!changed && suppressed_ < keyframe_interval_)
+        {
+            held_.emplace(event);
+            suppressed_++;
+            return;
+        }
+
+        // Write the last dropped event first, otherwise the change would appear to have
+        // happened gradually since the last written event
+        if (changed && held_)
+        {
+            writer_.write(*held_);
+        }
+
+        writer_.write(event);
+        written_ = current_;
+        held_.reset();
+        suppressed_ = 0;
+    }
+
+private:
+    otf2::writer::local& writer_;
+    std::uint64_t keyframe_interval_;
+    double relative_epsilon_;
+    double absolute_epsilon_;
+
+    std::vector<double> current_;
+    std::vector<double> written_;
+    // The last dropped event
+    std::optional<otf2::event::metric> held_;
+    std::uint64_t suppressed_ = 0;
+};
+} // namespace metric
+} // namespace lo2s
@@ -39,7 +39,7 @@ public:
             trace::Trace& trace, const otf2::definition::metric_class& metric_class);
 
 protected:
-    void monitor(int fd) override;
+    void on_timer() override;
     void initialize_thread() override;
 
     std::string group() const override
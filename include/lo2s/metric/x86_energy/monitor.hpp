@@ -31,7 +31,7 @@ public:
             const otf2::definition::system_tree_node& stn);
 
 protected:
-    void monitor(int fd) override;
+    void on_timer() override;
     void initialize_thread() override;
 
     std::string group() const override
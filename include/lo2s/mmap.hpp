@@ -23,18 +23,26 @@
 
 #include <lo2s/address.hpp>
 #include <lo2s/bfd_resolve.hpp>
+#include <lo2s/deferred_symbols.hpp>
+#include <lo2s/line_scanner.hpp>
 #ifdef HAVE_RADARE
 #include <lo2s/radare.hpp>
 #endif
+#include <lo2s/symbol_cache.hpp>
 #include <lo2s/types.hpp>
 #include <lo2s/util.hpp>
 
+#include <algorithm>
 #include <deque>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <regex>
+#include <string_view>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 extern "C"
 {
@@ -102,12 +110,17 @@ class BfdRadareBinary : public Binary
 {
 public:
     BfdRadareBinary(const std::string& name)
-    : Binary(name), bfd_(name)
+    : Binary(name), cache_(SymbolCache::instance().open(name))
 #ifdef HAVE_RADARE
       ,
       radare_(name)
 #endif
     {
+        // Binaries that were resolved in previous runs are only opened by BFD on a cache miss
+        if (cache_ == nullptr || cache_->empty())
+        {
+            bfd_ = std::make_unique<bfdr::Lib>(name);
+        }
     }
 
     static Binary& cache(const std::string& name)
@@ -118,79 +131,120 @@ public:
 #ifdef HAVE_RADARE
     virtual std::string lookup_instruction(Address ip) override
     {
+        std::lock_guard<std::mutex> guard(mutex_);
         return radare_.instruction(ip);
     }
 #endif
 
+    // libbfd caches the debug info of a handle internally, so lookups must not run concurrently
     virtual LineInfo lookup_line_info(Address ip) override
     {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (cache_ != nullptr)
+        {
+            if (auto line_info = cache_->lookup(ip, name()))
+            {
+                return *line_info;
+            }
+        }
+
+        LineInfo line_info = LineInfo::for_unknown_function_in_dso(name());
         try
         {
-            return bfd_.lookup(ip);
+            if (!bfd_)
+            {
+                bfd_ = std::make_unique<bfdr::Lib>(name());
+            }
+            line_info = bfd_->lookup(ip);
         }
         catch (bfdr::LookupError&)
         {
-            return LineInfo::for_unknown_function_in_dso(name());
         }
+        catch (std::runtime_error& e)
+        {
+            // InitError or InvalidFileError, the binary is gone since it was cached
+            Log::debug() << "could not open " << name() << " after a symbol cache miss: "
+                         << e.what();
+            cache_ = nullptr;
+            return line_info;
+        }
+
+        if (cache_ != nullptr)
+        {
+            cache_->insert(ip, line_info);
+        }
+        return line_info;
     }
 
 private:
-    bfdr::Lib bfd_;
+    std::mutex mutex_;
+    SymbolCache::File* cache_;
+    // Opened lazily if all lookups so far were served by the symbol cache
+    std::unique_ptr<bfdr::Lib> bfd_;
 #ifdef HAVE_RADARE
     RadareResolver radare_;
 #endif // HAVE_RADARE
 };
 
-class Kallsyms : public Binary
+// Binary whose symbols are resolved after the measurement by lo2s-resolve, see DeferredSymbols
+class DeferredBinary : public Binary
 {
 public:
-    Kallsyms() : Binary("[kernel]")
+    DeferredBinary(const std::string& name) : Binary(name)
     {
-        std::map<Address, std::string> entries;
-        std::ifstream ksyms_file("/proc/kallsyms");
+    }
 
-        std::regex ksym_regex("([0-9a-f]+) (?:t|T) ([^[:space:]]+)");
-        std::smatch ksym_match;
+    static Binary& cache(const std::string& name)
+    {
+        return StringCache<DeferredBinary>::instance()[name];
+    }
 
-        std::string line;
+    virtual std::string lookup_instruction(Address) override
+    {
+        throw std::domain_error("Unknown instruction.");
+    }
 
-        // Emplacing into entries map takes care of sorting symbols by address
-        while (getline(ksyms_file, line))
-        {
-            if (std::regex_match(line, ksym_match, ksym_regex))
-            {
-                std::string sym_str = ksym_match[2];
-                uint64_t sym_addr = stoull(ksym_match[1], nullptr, 16);
-                entries.emplace(std::piecewise_construct, std::forward_as_tuple(sym_addr),
-                                std::forward_as_tuple(sym_str));
-            }
-        }
+    virtual LineInfo lookup_line_info(Address ip) override
+    {
+        return DeferredSymbols::instance().add(name(), ip);
+    }
+};
 
-        std::string sym_str = "";
-        Address prev = 0;
+class Kallsyms : public Binary
+{
+public:
+    Kallsyms() : Binary("[kernel]")
+    {
+        LineScanner ksyms_file("/proc/kallsyms");
 
-        for (auto& entry : entries)
+        std::string_view line;
+        while (ksyms_file.next(line))
         {
-            if (prev != 0 && prev != entry.first)
+            // <address> <type> <name>, symbols of modules have an additional [<module>]
+            uint64_t sym_addr;
+            if (!scan::hex(line, sym_addr))
             {
-                kallsyms_.emplace(std::piecewise_construct,
-                                  std::forward_as_tuple(prev, entry.first),
-                                  std::forward_as_tuple(sym_str));
+                continue;
             }
-            else
+            auto type = scan::field(line);
+            auto name = scan::field(line);
+            scan::skip_spaces(line);
+            if ((type == "t" || type == "T") && !name.empty() && line.empty() && sym_addr != 0)
             {
-                start_ = entry.first.value();
+                kallsyms_.emplace_back(sym_addr, std::string(name));
             }
-            sym_str = entry.second;
-            prev = entry.first;
         }
 
-        if (sym_str != "")
-        {
-            kallsyms_.emplace(std::piecewise_construct,
-                              std::forward_as_tuple(prev, Address((uint64_t)-1)),
-                              std::forward_as_tuple(sym_str));
-        }
+        // Every symbol extends up to the next one, so of symbols sharing an address, only the
+        // first is ever found
+        std::stable_sort(kallsyms_.begin(), kallsyms_.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        auto same_address = [](const auto& a, const auto& b) { return a.first == b.first; };
+        kallsyms_.erase(std::unique(kallsyms_.begin(), kallsyms_.end(), same_address),
+                        kallsyms_.end());
+        kallsyms_.shrink_to_fit();
+
+        start_ = kallsyms_.empty() ? 0 : kallsyms_.front().first.value();
     }
 
     static Kallsyms& cache()
@@ -211,11 +265,19 @@ public:
 
     virtual LineInfo lookup_line_info(Address addr) override
     {
-        return LineInfo::for_function("[kernel]", kallsyms_.at(addr + start_).c_str(), 1, "");
+        addr = addr + start_;
+        auto it = std::upper_bound(kallsyms_.begin(), kallsyms_.end(), addr,
+                                   [](Address addr, const auto& sym) { return addr < sym.first; });
+        if (it == kallsyms_.begin())
+        {
+            throw std::out_of_range("address below the first kernel symbol");
+        }
+        return LineInfo::for_function("[kernel]", std::prev(it)->second.c_str(), 1, "");
     }
 
 private:
-    std::map<Range, std::string> kallsyms_;
+    // sorted by address
+    std::vector<std::pair<Address, std::string>> kallsyms_;
     uint64_t start_;
 };
 
@@ -271,6 +333,11 @@ public:
 
     LineInfo lookup_line_info(Address ip) const;
 
+    bool is_mapped(Address ip) const
+    {
+        return map_.count(ip) > 0;
+    }
+
     // Will throw alot - catch it if you can
     std::string lookup_instruction(Address ip) const;
 
@@ -25,6 +25,7 @@
 #include <lo2s/monitor/scope_monitor.hpp>
 #include <lo2s/types.hpp>
 
+#include <thread>
 #include <vector>
 
 namespace lo2s
@@ -41,10 +42,16 @@ class CpuSetMonitor : public MainMonitor
 public:
     CpuSetMonitor();
 
+    ~CpuSetMonitor();
+
     void run();
 
 private:
+    void prefill();
+    void finish_prefill();
+
     std::map<Cpu, ScopeMonitor> monitors_;
+    std::thread prefill_thread_;
 };
 } // namespace monitor
 } // namespace lo2s
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <lo2s/perf/bio/histogram_writer.hpp>
 #include <lo2s/perf/bio/writer.hpp>
 #include <lo2s/perf/io_reader.hpp>
 #include <lo2s/perf/multi_reader.hpp>
@@ -46,17 +47,14 @@ public:
     {
         for (auto fd : multi_reader_.get_fds())
         {
-            add_fd(fd);
+            add_fd(fd, [this]() { multi_reader_.read(); }, true);
         }
     }
 
 private:
-    void monitor(int fd) override
+    void on_stop() override
     {
-        if (fd != timer_pfd().fd)
-        {
-            multi_reader_.read();
-        }
+        multi_reader_.read();
     }
 
     void finalize_thread() override
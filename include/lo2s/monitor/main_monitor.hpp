@@ -42,6 +42,7 @@
 #include <lo2s/types.hpp>
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace lo2s
@@ -70,11 +71,13 @@ public:
 
 protected:
     trace::Trace trace_;
+    // Guards insertions, which may come from sample writers and from the /proc prefill
+    std::mutex process_infos_mutex_;
     std::map<Process, ProcessInfo> process_infos_;
     metric::plugin::Metrics metrics_;
     std::vector<std::unique_ptr<TracepointMonitor>> tracepoint_monitors_;
 
-    std::unique_ptr<IoMonitor<perf::bio::Writer>> bio_monitor_;
+    std::unique_ptr<PollMonitor> bio_monitor_;
 #ifdef HAVE_X86_ADAPT
     std::unique_ptr<metric::x86_adapt::Metrics> x86_adapt_metrics_;
 #endif
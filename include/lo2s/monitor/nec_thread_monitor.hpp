@@ -45,7 +45,7 @@ protected:
 
     void finalize_thread() override;
 
-    void monitor(int fd) override;
+    void on_timer() override;
 
 private:
     std::chrono::microseconds nec_read_interval_;
@@ -28,17 +28,23 @@
 #include <lo2s/trace/fwd.hpp>
 
 #include <chrono>
+#include <functional>
 #include <vector>
 
 extern "C"
 {
-#include <poll.h>
+#include <sys/epoll.h>
 }
 
 namespace lo2s
 {
 namespace monitor
 {
+// Event loop of a monitoring thread, based on epoll.
+//
+// Every file descriptor is registered together with the handler that is called once it becomes
+// readable, so that only the sources that actually have data are read. Periodic work is done in
+// on_timer(), which is called every read_interval if it is non-zero.
 class PollMonitor : public ThreadedMonitor
 {
 public:
@@ -49,28 +55,52 @@ public:
 
     ~PollMonitor();
 
+    // Instead of start() and stop(), the monitor can also be driven by another thread, see
+    // ReaderPool. Wait for epoll_fd() to become readable, then call handle_ready(), which returns
+    // false if polling should be stopped. finish() replaces stop().
+    int epoll_fd() const
+    {
+        return epoll_fd_;
+    }
+
+    bool handle_ready();
+    void finish();
+
 protected:
     void run() override;
-    void monitor();
+    bool dispatch(int timeout);
+
+    // Calls handler whenever fd becomes readable. With edge_triggered, handler is only called
+    // again once new data arrives, so it has to consume everything that is available, e.g.
+    // by reading a perf buffer until it is empty.
+    void add_fd(int fd, std::function<void()> handler, bool edge_triggered = false);
 
-    void add_fd(int fd);
+    // Calls handler every interval
+    void add_timer(std::chrono::nanoseconds interval, std::function<void()> handler);
 
-    virtual void monitor([[maybe_unused]] int fd){};
+    // Same as add_timer(), but for a timerfd owned by someone else
+    void add_timer_fd(int timer_fd, std::function<void()> handler);
 
-    struct pollfd& stop_pfd()
+    // Called on every expiration of the read interval timer
+    virtual void on_timer()
     {
-        return pfds_[0];
     }
 
-    struct pollfd& timer_pfd()
+    // Called once after the monitor was stopped, before finalize_thread(). By default, this does
+    // a last readout as if the timer expired.
+    virtual void on_stop()
     {
-        return pfds_[1];
+        on_timer();
     }
 
     Pipe stop_pipe_;
 
 private:
-    std::vector<pollfd> pfds_;
+    int epoll_fd_ = -1;
+    std::vector<std::function<void()>> handlers_;
+    std::vector<struct epoll_event> events_;
+    std::vector<int> timer_fds_;
+    bool stop_requested_ = false;
 };
 } // namespace monitor
 } // namespace lo2s
@@ -22,10 +22,12 @@
 #pragma once
 #include <lo2s/monitor/abstract_process_monitor.hpp>
 #include <lo2s/monitor/main_monitor.hpp>
+#include <lo2s/monitor/reader_pool.hpp>
 #include <lo2s/monitor/scope_monitor.hpp>
 #include <lo2s/process_info.hpp>
 
 #include <map>
+#include <optional>
 #include <string>
 
 extern "C"
@@ -54,6 +56,10 @@ public:
 
 private:
     std::map<Thread, ScopeMonitor> threads_;
+    // with --per-cpu-inherit, these record sampling and context switches for all threads
+    std::map<Cpu, ScopeMonitor> cpus_;
+    // with --reader-pool, the ScopeMonitors live in here instead of threads_
+    std::optional<ReaderPool> reader_pool_;
 };
 } // namespace monitor
 } // namespace lo2s
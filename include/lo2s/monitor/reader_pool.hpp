@@ -0,0 +1,84 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/types.hpp>
+#include <lo2s/monitor/poll_monitor.hpp>
+#include <lo2s/pipe.hpp>
+#include <lo2s/trace/fwd.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lo2s
+{
+namespace monitor
+{
+// Reads the perf buffers of many threads using a fixed number of worker threads, instead of
+// spawning one monitoring thread per monitored thread.
+//
+// The epoll instances of the inserted monitors are registered in one shared epoll instance in
+// one-shot mode. Every worker takes the next monitor that has pending data, reads it, and
+// re-arms it afterwards. So a monitor is only ever read by one worker at a time, but idle workers
+// pick up whatever is ready, regardless of which worker handled that monitor before.
+class ReaderPool
+{
+public:
+    ReaderPool(trace::Trace& trace, std::size_t size);
+    ~ReaderPool();
+
+    ReaderPool(const ReaderPool&) = delete;
+    ReaderPool& operator=(const ReaderPool&) = delete;
+
+    void insert(Thread thread, std::unique_ptr<PollMonitor> monitor);
+
+    // Does the final readout of the monitor of thread and destroys it
+    void remove(Thread thread);
+
+private:
+    struct Entry
+    {
+        std::mutex mutex;
+        std::unique_ptr<PollMonitor> monitor;
+    };
+
+    void worker_main(std::size_t index);
+    void remove_entry(std::uint64_t id);
+
+    trace::Trace& trace_;
+    int epoll_fd_ = -1;
+    Pipe stop_pipe_;
+
+    std::mutex mutex_;
+    std::uint64_t next_id_ = 1;
+    std::map<std::uint64_t, std::shared_ptr<Entry>> entries_;
+    std::map<Thread, std::uint64_t> ids_;
+
+    std::vector<std::thread> workers_;
+};
+} // namespace monitor
+} // namespace lo2s
@@ -28,6 +28,7 @@
 #include <lo2s/perf/counter/group/writer.hpp>
 #include <lo2s/perf/counter/userspace/writer.hpp>
 #include <lo2s/perf/sample/writer.hpp>
+#include <lo2s/perf/shared_buffer_reader.hpp>
 #include <lo2s/perf/syscall/writer.hpp>
 
 #include <array>
@@ -36,6 +37,7 @@
 #include <thread>
 
 #include <cstddef>
+#include <cstdint>
 
 extern "C"
 {
@@ -51,12 +53,15 @@ namespace monitor
 class ScopeMonitor : public PollMonitor
 {
 public:
+    // With a valid inherit_process, scope is a cpu on which only the sampling and context switch
+    // events of inherit_process and its children are recorded, see --per-cpu-inherit
     ScopeMonitor(ExecutionScope scope, MainMonitor& parent, bool enable_on_exec,
-                 bool is_process = false);
+                 bool is_process = false, Process inherit_process = Process::invalid());
 
     void initialize_thread() override;
     void finalize_thread() override;
-    void monitor(int fd) override;
+    void on_timer() override;
+    void on_stop() override;
 
     std::string group() const override
     {
@@ -71,12 +76,33 @@ public:
     }
 
 private:
+    // perf buffers are drained completely on every wakeup, so they can be edge-triggered
+    template <class Reader>
+    void add_perf_reader(Reader& reader)
+    {
+        add_fd(
+            reader.fd(),
+            [this, &reader]() {
+                pin_to_scope();
+                reader.read();
+            },
+            true);
+    }
+
+    void pin_to_scope();
+    void read_all(bool stopping);
+    void flight_recorder_dump(bool stopping);
+
     ExecutionScope scope_;
+    // declared first, as the writers below redirect their events into it
+    std::unique_ptr<perf::SharedBufferReader> shared_buffer_reader_;
     std::unique_ptr<perf::syscall::Writer> syscall_writer_;
     std::unique_ptr<perf::sample::Writer> sample_writer_;
     std::unique_ptr<perf::counter::group::Writer> group_counter_writer_;
     std::unique_ptr<perf::counter::userspace::Writer> userspace_counter_writer_;
     std::unique_ptr<cupti::Reader> cupti_reader_;
+
+    std::uint64_t flight_recorder_generation_ = 0;
 };
 } // namespace monitor
 } // namespace lo2s
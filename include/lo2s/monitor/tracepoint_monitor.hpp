@@ -40,7 +40,7 @@ public:
     TracepointMonitor(trace::Trace& trace, Cpu cpu);
 
 private:
-    void monitor(int fd) override;
+    void on_stop() override;
     void initialize_thread() override;
     void finalize_thread() override;
 
@@ -0,0 +1,454 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/config.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/perf/bio/block_device.hpp>
+#include <lo2s/perf/bio/writer.hpp>
+#include <lo2s/perf/event_provider.hpp>
+#include <lo2s/perf/io_reader.hpp>
+#include <lo2s/perf/time/converter.hpp>
+#include <lo2s/trace/trace.hpp>
+
+#include <otf2xx/definition/metric_class.hpp>
+#include <otf2xx/event/metric.hpp>
+#include <otf2xx/writer/local.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#include <sys/sysmacros.h>
+}
+
+namespace lo2s
+{
+namespace perf
+{
+namespace bio
+{
+
+// Requests that were queued but not completed yet, keyed by device and sector.
+//
+// Open addressing with linear probing and a fixed capacity. Requests which never complete, e.g.
+// because they were merged into another one, would fill up the table over time. They are
+// expired regularly, and if there is still no free slot within MAX_PROBE slots of its home, the
+// oldest request there is evicted. So every entry lies within MAX_PROBE slots of its home.
+class InflightTable
+{
+public:
+    struct Entry
+    {
+        bool used = false;
+        uint32_t dev;
+        uint64_t sector;
+        uint64_t queue_time;
+        uint64_t issue_time;
+    };
+
+    InflightTable() : slots_(CAPACITY)
+    {
+    }
+
+    Entry* find(uint32_t dev, uint64_t sector)
+    {
+        for (std::size_t i = 0, pos = home(dev, sector); i < MAX_PROBE; i++, pos = next(pos))
+        {
+            auto& slot = slots_[pos];
+            if (!slot.used)
+            {
+                return nullptr;
+            }
+            if (slot.dev == dev && slot.sector == sector)
+            {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns the entry for (dev, sector), which is newly created unless it already existed
+    Entry& insert(uint32_t dev, uint64_t sector)
+    {
+        Entry* oldest = nullptr;
+        for (std::size_t i = 0, pos = home(dev, sector); i < MAX_PROBE; i++, pos = next(pos))
+        {
+            auto& slot = slots_[pos];
+            if (!slot.used || (slot.dev == dev && slot.sector == sector))
+            {
+                return init(slot, dev, sector);
+            }
+            if (oldest == nullptr || slot.queue_time < oldest->queue_time)
+            {
+                oldest = &slot;
+            }
+        }
+
+        // The evicted entry stays within MAX_PROBE of the home of the new one, so the table
+        // remains consistent
+        num_evicted_++;
+        return init(*oldest, dev, sector);
+    }
+
+    void erase(Entry* entry)
+    {
+        // Backward shift deletion, so that lookups can stop at the first free slot. Entries
+        // MAX_PROBE or more slots behind the hole have their home behind it too, so the search
+        // ends there even if the table is full.
+        std::size_t hole = entry - slots_.data();
+        for (std::size_t pos = next(hole); slots_[pos].used && distance(hole, pos) < MAX_PROBE;
+             pos = next(pos))
+        {
+            auto entry_home = home(slots_[pos].dev, slots_[pos].sector);
+            // Entries whose home lies cyclically in (hole, pos] have to stay where they are
+            bool stays = (hole <= pos) ? (hole < entry_home && entry_home <= pos)
+                                       : (hole < entry_home || entry_home <= pos);
+            if (!stays)
+            {
+                slots_[hole] = slots_[pos];
+                hole = pos;
+            }
+        }
+        slots_[hole].used = false;
+    }
+
+    // Removes all requests queued before time
+    void expire(uint64_t time)
+    {
+        for (std::size_t pos = 0; pos < CAPACITY;)
+        {
+            // erase() may shift the next entry into pos, so look at it again
+            if (slots_[pos].used && slots_[pos].queue_time < time)
+            {
+                erase(&slots_[pos]);
+            }
+            else
+            {
+                pos++;
+            }
+        }
+    }
+
+    std::size_t num_evicted() const
+    {
+        return num_evicted_;
+    }
+
+private:
+    static constexpr std::size_t CAPACITY = 1 << 16;
+    static constexpr std::size_t MAX_PROBE = 32;
+
+    static std::size_t home(uint32_t dev, uint64_t sector)
+    {
+        return ((sector ^ (static_cast<uint64_t>(dev) << 40)) * 0x9e3779b97f4a7c15ULL) >> 48;
+    }
+
+    static std::size_t next(std::size_t pos)
+    {
+        return (pos + 1) & (CAPACITY - 1);
+    }
+
+    // Number of slots from pos forward to other, wrapping around at the end
+    static std::size_t distance(std::size_t pos, std::size_t other)
+    {
+        return (other - pos) & (CAPACITY - 1);
+    }
+
+    static Entry& init(Entry& slot, uint32_t dev, uint64_t sector)
+    {
+        slot.used = true;
+        slot.dev = dev;
+        slot.sector = sector;
+        slot.queue_time = 0;
+        slot.issue_time = 0;
+        return slot;
+    }
+
+    std::vector<Entry> slots_;
+    std::size_t num_evicted_ = 0;
+};
+
+// Alternative to Writer, which does not write an event for every request, but a histogram of the
+// request latencies and sizes per device and direction every read interval. The histograms are
+// written as metrics, where every bucket is a member counting the requests that completed in
+// the interval since the last metric event.
+class HistogramWriter
+{
+public:
+    HistogramWriter(trace::Trace& trace)
+    : trace_(trace), time_converter_(time::Converter::instance()),
+      interval_(std::max<uint64_t>(config().read_interval.count(), 1)),
+      metric_class_(trace.metric_class())
+    {
+        for (const char* direction : { "read", "write" })
+        {
+            for (const char* kind : { "latency", "device latency" })
+            {
+                for (std::size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+                {
+                    add_member(direction, kind, bucket, LATENCY_BUCKETS, 0, "us");
+                }
+            }
+            for (std::size_t bucket = 0; bucket < SIZE_BUCKETS; bucket++)
+            {
+                add_member(direction, "size", bucket, SIZE_BUCKETS, MIN_SIZE_SHIFT, "B");
+            }
+        }
+    }
+
+    HistogramWriter(const HistogramWriter&) = delete;
+    HistogramWriter& operator=(const HistogramWriter&) = delete;
+
+    // tracepoint is the index of the event's tracepoint in get_tracepoints()
+    void write(std::size_t tracepoint, TracepointSampleType* header)
+    {
+        advance_interval(header->time);
+
+        if (tracepoint == BIO_QUEUE)
+        {
+            auto event = reinterpret_cast<RecordBioQueue*>(header);
+            if (event->rwbs[0] != 'R' && event->rwbs[0] != 'W')
+            {
+                return;
+            }
+            inflight_.insert(event->dev, event->sector).queue_time = header->time;
+        }
+        else if (tracepoint == BIO_ISSUE)
+        {
+            auto event = reinterpret_cast<RecordBlock*>(header);
+            if (auto entry = inflight_.find(event->dev, event->sector))
+            {
+                entry->issue_time = header->time;
+            }
+        }
+        else if (tracepoint == BIO_COMPLETE)
+        {
+            auto event = reinterpret_cast<RecordBlock*>(header);
+            auto entry = inflight_.find(event->dev, event->sector);
+            if (entry == nullptr)
+            {
+                return;
+            }
+
+            if (event->rwbs[0] == 'R' || event->rwbs[0] == 'W')
+            {
+                auto& counts = device(event->dev).counts;
+                std::size_t base = (event->rwbs[0] == 'R') ? 0 : MEMBERS_PER_DIRECTION;
+
+                counts[base + log_bucket(micros_since(entry->queue_time, header->time), 0,
+                                         LATENCY_BUCKETS)]++;
+                if (entry->issue_time != 0)
+                {
+                    counts[base + LATENCY_BUCKETS +
+                           log_bucket(micros_since(entry->issue_time, header->time), 0,
+                                      LATENCY_BUCKETS)]++;
+                }
+                // The completed request may consist of several merged bios, so this is the
+                // actual size
+                counts[base + 2 * LATENCY_BUCKETS +
+                       log_bucket(uint64_t(event->nr_sector) * SECTOR_SIZE, MIN_SIZE_SHIFT,
+                                  SIZE_BUCKETS)]++;
+            }
+            inflight_.erase(entry);
+        }
+        else
+        {
+            throw std::runtime_error("tracepoint " + std::to_string(tracepoint) +
+                                     " not valid for block I/O");
+        }
+    }
+
+    void finalize()
+    {
+        if (last_time_ != 0)
+        {
+            write_histograms(last_time_);
+        }
+
+        if (inflight_.num_evicted() > 0)
+        {
+            Log::warn() << "Discarded " << inflight_.num_evicted()
+                        << " block I/O requests that did not complete in time";
+        }
+    }
+
+    std::vector<perf::tracepoint::TracepointEvent> get_tracepoints()
+    {
+        // in the order of BIO_QUEUE, BIO_ISSUE and BIO_COMPLETE
+        return {
+            perf::EventProvider::instance().create_tracepoint_event("block:block_bio_queue"),
+            perf::EventProvider::instance().create_tracepoint_event("block:block_rq_issue"),
+            perf::EventProvider::instance().create_tracepoint_event("block:block_rq_complete")
+        };
+    }
+
+private:
+    struct DeviceHistograms
+    {
+        DeviceHistograms(otf2::writer::local& writer,
+                         const otf2::definition::metric_instance& instance)
+        : writer(writer), event(otf2::chrono::genesis(), instance), counts(NUM_MEMBERS, 0)
+        {
+        }
+
+        otf2::writer::local& writer;
+        otf2::event::metric event;
+        std::vector<uint64_t> counts;
+    };
+
+    void add_member(const char* direction, const char* kind, std::size_t bucket,
+                    std::size_t num_buckets, std::size_t shift, const char* unit)
+    {
+        auto lower = (bucket == 0) ? 0 : (uint64_t(1) << (bucket + shift));
+        std::string range =
+            (bucket + 1 == num_buckets)
+                ? fmt::format("[{}{}, inf)", lower, unit)
+                : fmt::format("[{}{}, {}{})", lower, unit, uint64_t(1) << (bucket + shift + 1),
+                              unit);
+
+        metric_class_.add_member(trace_.metric_member(
+            fmt::format("block I/O {} {} {}", direction, kind, range),
+            fmt::format("Number of block I/O {} requests with a {} in {}", direction, kind, range),
+            otf2::common::metric_mode::absolute_last, otf2::common::type::int64, "#"));
+    }
+
+    // The clocks of different CPUs may be slightly off, so the end could be before the start
+    static uint64_t micros_since(uint64_t start, uint64_t end)
+    {
+        return (end > start) ? (end - start) / 1000 : 0;
+    }
+
+    // Bucket i holds the values in [2^(i + shift), 2^(i + shift + 1)), with the first and last
+    // bucket open towards 0 and infinity respectively
+    static std::size_t log_bucket(uint64_t value, std::size_t shift, std::size_t num_buckets)
+    {
+        value >>= shift;
+        if (value <= 1)
+        {
+            return 0;
+        }
+        return std::min<std::size_t>(63 - __builtin_clzll(value), num_buckets - 1);
+    }
+
+    DeviceHistograms& device(uint32_t dev)
+    {
+        auto it = devices_.find(dev);
+        if (it != devices_.end())
+        {
+            return it->second;
+        }
+
+        // See Writer::block_device_for
+        auto device = BlockDevice::block_device_for(makedev(dev >> 20, dev & ((1U << 20) - 1)));
+        auto& writer =
+            trace_.create_metric_writer(fmt::format("block I/O histograms for {}", device.name));
+        auto instance = trace_.metric_instance(metric_class_, writer.location(), writer.location());
+        return devices_.try_emplace(dev, writer, instance).first->second;
+    }
+
+    // Writes the histograms of every interval that ended before time
+    void advance_interval(uint64_t time)
+    {
+        last_time_ = time;
+        if (interval_end_ == 0)
+        {
+            interval_end_ = time + interval_;
+            return;
+        }
+        if (time < interval_end_)
+        {
+            return;
+        }
+
+        write_histograms(interval_end_);
+        // Skip intervals without any events
+        interval_end_ += ((time - interval_end_) / interval_ + 1) * interval_;
+
+        // Requests that are still in flight by now are most likely bios that were merged into
+        // another request, which only completes under the sector of its first bio
+        auto max_age = std::max(EXPIRE_INTERVALS * interval_, MIN_EXPIRE_AGE);
+        if (time > max_age)
+        {
+            inflight_.expire(time - max_age);
+        }
+    }
+
+    void write_histograms(uint64_t time)
+    {
+        auto tp = time_converter_(time);
+        for (auto& device : devices_)
+        {
+            auto& histograms = device.second;
+            histograms.event.timestamp(tp);
+            for (std::size_t i = 0; i < NUM_MEMBERS; i++)
+            {
+                histograms.event.raw_values()[i] = static_cast<std::int64_t>(histograms.counts[i]);
+                histograms.counts[i] = 0;
+            }
+            histograms.writer.write(histograms.event);
+        }
+    }
+
+    static constexpr std::size_t BIO_QUEUE = 0;
+    static constexpr std::size_t BIO_ISSUE = 1;
+    static constexpr std::size_t BIO_COMPLETE = 2;
+
+    // latency buckets are in microseconds, from [0us, 2us) to [2^19us, inf), i.e. ~0.5s
+    static constexpr std::size_t LATENCY_BUCKETS = 20;
+    // size buckets are in bytes, from [0B, 1KiB) to [2^24B, inf)
+    static constexpr std::size_t SIZE_BUCKETS = 15;
+    static constexpr std::size_t MIN_SIZE_SHIFT = 9;
+    // latency, device latency and size
+    static constexpr std::size_t MEMBERS_PER_DIRECTION = 2 * LATENCY_BUCKETS + SIZE_BUCKETS;
+    static constexpr std::size_t NUM_MEMBERS = 2 * MEMBERS_PER_DIRECTION;
+
+    static constexpr uint64_t SECTOR_SIZE = 512;
+
+    // Requests are dropped from the inflight table after this many intervals, but not before
+    // they are one second old
+    static constexpr uint64_t EXPIRE_INTERVALS = 4;
+    static constexpr uint64_t MIN_EXPIRE_AGE = 1000000000;
+
+    trace::Trace& trace_;
+    time::Converter& time_converter_;
+    uint64_t interval_;
+    uint64_t interval_end_ = 0;
+    uint64_t last_time_ = 0;
+
+    otf2::definition::metric_class& metric_class_;
+    InflightTable inflight_;
+    // keyed by the raw device number of the tracepoints
+    std::map<uint32_t, DeviceHistograms> devices_;
+};
+} // namespace bio
+} // namespace perf
+} // namespace lo2s
@@ -80,9 +80,10 @@ public:
     {
     }
 
-    void write(IoReaderIdentity& identity, TracepointSampleType* header)
+    // tracepoint is the index of the event's tracepoint in get_tracepoints()
+    void write(std::size_t tracepoint, TracepointSampleType* header)
     {
-        if (identity.tracepoint() == bio_queue_)
+        if (tracepoint == BIO_QUEUE)
         {
             struct RecordBioQueue* event = (RecordBioQueue*)header;
 
@@ -112,7 +113,7 @@ public:
                 time_converter_(event->header.time), handle, mode,
                 otf2::common::io_operation_flag_type::non_blocking, size, event->sector);
         }
-        else if (identity.tracepoint() == bio_issue_)
+        else if (tracepoint == BIO_ISSUE)
         {
             struct RecordBlock* event = (RecordBlock*)header;
 
@@ -129,7 +130,7 @@ public:
             writer << otf2::event::io_operation_issued(time_converter_(event->header.time), handle,
                                                        event->sector);
         }
-        else if (identity.tracepoint() == bio_complete_)
+        else if (tracepoint == BIO_COMPLETE)
         {
             struct RecordBlock* event = (RecordBlock*)header;
 
@@ -150,11 +151,15 @@ public:
         }
         else
         {
-            throw std::runtime_error("tracepoint " + identity.tracepoint().name() +
+            throw std::runtime_error("tracepoint " + std::to_string(tracepoint) +
                                      " not valid for block I/O");
         }
     }
 
+    void finalize()
+    {
+    }
+
     std::vector<perf::tracepoint::TracepointEvent> get_tracepoints()
     {
         bio_queue_ =
@@ -164,6 +169,7 @@ public:
         bio_complete_ =
             perf::EventProvider::instance().create_tracepoint_event("block:block_rq_complete");
 
+        // in the order of BIO_QUEUE, BIO_ISSUE and BIO_COMPLETE
         return { bio_queue_.value(), bio_issue_.value(), bio_complete_.value() };
     }
 
@@ -189,6 +195,10 @@ private:
     std::optional<perf::tracepoint::TracepointEvent> bio_issue_;
     std::optional<perf::tracepoint::TracepointEvent> bio_complete_;
 
+    static constexpr std::size_t BIO_QUEUE = 0;
+    static constexpr std::size_t BIO_ISSUE = 1;
+    static constexpr std::size_t BIO_COMPLETE = 2;
+
     // The unit "sector" is always 512 bit large, regardless of the actual sector size of the device
     static constexpr int SECTOR_SIZE = 512;
 };
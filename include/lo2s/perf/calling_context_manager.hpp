@@ -25,6 +25,12 @@
 
 #include <otf2xx/otf2.hpp>
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
 namespace lo2s
 {
 namespace perf
@@ -33,7 +39,8 @@ namespace perf
 class CallingContextManager
 {
 public:
-    CallingContextManager(trace::Trace& trace) : local_cctx_refs_(trace.create_cctx_refs())
+    CallingContextManager(trace::Trace& trace)
+    : trace_(trace), local_cctx_refs_(trace.create_cctx_refs())
     {
     }
 
@@ -52,12 +59,38 @@ public:
 
     void finalize(otf2::writer::local* otf2_writer)
     {
+        if (callchain_cache_hits_ + callchain_cache_misses_ > 0)
+        {
+            Log::debug() << "call chain cache: " << callchain_cache_hits_ << " hits, "
+                         << callchain_cache_misses_ << " misses ("
+                         << 100. * callchain_cache_hits_ /
+                                (callchain_cache_hits_ + callchain_cache_misses_)
+                         << "% hit rate)";
+        }
+
         local_cctx_refs_.ref_count = next_cctx_ref_;
         // set writer last, because it is used as sentry to confirm that the cctx refs are properly
         // finalized.
         local_cctx_refs_.writer = otf2_writer;
     }
 
+    // Hands the calling contexts created since the last call to the background merger
+    void hand_off()
+    {
+        std::vector<trace::CctxDelta> deltas;
+        for (auto& thread_cctx : local_cctx_refs_.map)
+        {
+            if (thread_cctx.second.handed_off < thread_cctx.second.tree.size())
+            {
+                deltas.emplace_back(thread_cctx.second.take_delta(thread_cctx.first));
+            }
+        }
+        if (!deltas.empty())
+        {
+            trace_.hand_off_calling_contexts(local_cctx_refs_, std::move(deltas));
+        }
+    }
+
     bool thread_changed(Thread thread)
     {
         return !current_thread_cctx_refs_ || current_thread_cctx_refs_->first != thread;
@@ -67,7 +100,7 @@ public:
     {
         if (current_thread_cctx_refs_)
         {
-            return current_thread_cctx_refs_->second.entry.ref;
+            return current_thread_cctx_refs_->second.tree.value(trace::IpRefTree::ROOT);
         }
         else
         {
@@ -77,6 +110,52 @@ public:
 
     otf2::definition::calling_context::reference_type sample_ref(uint64_t num_ips,
                                                                  const uint64_t ips[])
+    {
+        if (num_ips < 2)
+        {
+            return walk_ips(num_ips, ips);
+        }
+
+        // Samples in hot code mostly repeat the exact same call chain, so remember the result of
+        // the last walk for each call chain hash
+        auto hash = hash_ips(num_ips, ips);
+        auto& cached = callchain_cache_[hash & (CALLCHAIN_CACHE_SIZE - 1)];
+        if (cached.hash == hash && cached.thread_cctx_refs == current_thread_cctx_refs_ &&
+            cached.ips.size() == num_ips - 1 &&
+            std::equal(cached.ips.begin(), cached.ips.end(), ips + 1))
+        {
+            callchain_cache_hits_++;
+            return cached.ref;
+        }
+
+        callchain_cache_misses_++;
+        cached.hash = hash;
+        cached.thread_cctx_refs = current_thread_cctx_refs_;
+        cached.ips.assign(ips + 1, ips + num_ips);
+        cached.ref = walk_ips(num_ips, ips);
+        return cached.ref;
+    }
+
+    otf2::definition::calling_context::reference_type sample_ref(uint64_t ip)
+    {
+        auto& tree = current_thread_cctx_refs_->second.tree;
+        return tree.value(find_ip_child(ip, trace::IpRefTree::ROOT));
+    }
+
+    void thread_leave(Thread thread)
+    {
+        assert(current_thread_cctx_refs_);
+        if (current_thread_cctx_refs_->first != thread)
+        {
+            Log::debug() << "inconsistent leave thread"; // will probably set to trace sooner or
+                                                         // later
+        }
+        current_thread_cctx_refs_ = nullptr;
+    }
+
+private:
+    otf2::definition::calling_context::reference_type walk_ips(uint64_t num_ips,
+                                                               const uint64_t ips[])
     {
         // For unwind distance definiton, see:
         // http://scorepci.pages.jsc.fz-juelich.de/otf2-pipelines/docs/otf2-2.2/html/group__records__definition.
@@ -96,40 +175,30 @@ public:
         // information.
         //
         // Having these things in mind, look at this line and tell me, why it is still wrong:
-        auto children = &current_thread_cctx_refs_->second.entry.children;
+        auto node = trace::IpRefTree::ROOT;
         for (uint64_t i = num_ips - 1;; i--)
         {
-            auto it = find_ip_child(ips[i], *children);
+            node = find_ip_child(ips[i], node);
             // We intentionally discard the last sample as it is somewhere in the kernel
             if (i == 1)
             {
-                return it->second.ref;
+                return current_thread_cctx_refs_->second.tree.value(node);
             }
-
-            children = &it->second.children;
         }
     }
 
-    otf2::definition::calling_context::reference_type sample_ref(uint64_t ip)
-    {
-        auto it = find_ip_child(ip, current_thread_cctx_refs_->second.entry.children);
-
-        return it->second.ref;
-    }
-
-    void thread_leave(Thread thread)
+    // Multiply-xor over the call chain, without the kernel entry that walk_ips() discards
+    static uint64_t hash_ips(uint64_t num_ips, const uint64_t ips[])
     {
-        assert(current_thread_cctx_refs_);
-        if (current_thread_cctx_refs_->first != thread)
+        uint64_t hash = num_ips;
+        for (uint64_t i = 1; i < num_ips; i++)
         {
-            Log::debug() << "inconsistent leave thread"; // will probably set to trace sooner or
-                                                         // later
+            hash = (hash ^ ips[i]) * 0x9e3779b97f4a7c15;
         }
-        current_thread_cctx_refs_ = nullptr;
+        return hash ^ (hash >> 32);
     }
 
-private:
-    trace::IpRefMap::iterator find_ip_child(Address addr, trace::IpRefMap& children)
+    trace::IpRefTree::index_type find_ip_child(Address addr, trace::IpRefTree::index_type parent)
     {
         // -1 can't be inserted into the ip map, as it imples a 1-byte region from -1 to 0.
         if (addr == -1)
@@ -137,8 +206,7 @@ private:
             Log::debug() << "Got invalid ip (-1) from call stack. Replacing with -2.";
             addr = -2;
         }
-        auto ret = children.emplace(std::piecewise_construct, std::forward_as_tuple(addr),
-                                    std::forward_as_tuple(next_cctx_ref_));
+        auto ret = current_thread_cctx_refs_->second.tree.emplace(parent, addr, next_cctx_ref_);
         if (ret.second)
         {
             next_cctx_ref_++;
@@ -147,9 +215,27 @@ private:
     }
 
 private:
+    struct CachedCallchain
+    {
+        uint64_t hash = 0;
+        const trace::ThreadCctxRefMap::value_type* thread_cctx_refs = nullptr;
+        std::vector<uint64_t> ips;
+        otf2::definition::calling_context::reference_type ref =
+            otf2::definition::calling_context::reference_type::undefined();
+    };
+
+    static constexpr std::size_t CALLCHAIN_CACHE_SIZE = 4096;
+
+    trace::Trace& trace_;
     trace::ThreadCctxRefMap& local_cctx_refs_;
     size_t next_cctx_ref_ = 0;
     trace::ThreadCctxRefMap::value_type* current_thread_cctx_refs_ = nullptr;
+
+    // Direct mapped, indexed by the call chain hash
+    std::vector<CachedCallchain> callchain_cache_ =
+        std::vector<CachedCallchain>(CALLCHAIN_CACHE_SIZE);
+    uint64_t callchain_cache_hits_ = 0;
+    uint64_t callchain_cache_misses_ = 0;
 };
 } // namespace perf
 } // namespace lo2s
@@ -23,6 +23,8 @@
 
 #include <lo2s/perf/event.hpp>
 
+#include <algorithm>
+#include <cstddef>
 #include <optional>
 #include <vector>
 
@@ -36,6 +38,28 @@ struct CounterCollection
 {
     std::optional<Event> leader_;
     std::vector<Event> counters;
+    // If the counters do not fit onto the PMU at once, they are split into several groups, each
+    // of which is opened with its own copy of the leader. These are the indices into counters at
+    // which the groups start.
+    std::vector<std::size_t> group_starts;
+
+    std::size_t group_count() const
+    {
+        return std::max<std::size_t>(group_starts.size(), 1);
+    }
+
+    std::size_t group_start(std::size_t group) const
+    {
+        return group_starts.empty() ? 0 : group_starts[group];
+    }
+
+    // Number of counters in the group, not including the leader
+    std::size_t group_size(std::size_t group) const
+    {
+        std::size_t end =
+            group + 1 < group_starts.size() ? group_starts[group + 1] : counters.size();
+        return end - group_start(group);
+    }
 
     double get_scale(int index) const
     {
@@ -23,8 +23,10 @@
 
 #include <lo2s/measurement_scope.hpp>
 #include <lo2s/perf/counter/counter_collection.hpp>
+#include <lo2s/perf/counter/derived_metric.hpp>
 #include <lo2s/perf/tracepoint/event.hpp>
 
+#include <cstddef>
 #include <optional>
 #include <vector>
 
@@ -51,16 +53,36 @@ public:
                                    const std::vector<std::string>& counters);
     void initialize_userspace_counters(const std::vector<std::string>& counters);
     void initialize_tracepoints(const std::vector<std::string>& tracepoints);
+    // Has to be called after initialize_group_counters()
+    void initialize_derived_metrics(const std::vector<std::string>& definitions, bool only);
 
     bool has_group_counters(ExecutionScope scope);
     bool has_userspace_counters(ExecutionScope scope);
 
     CounterCollection collection_for(MeasurementScope scope);
+
+    const std::vector<DerivedMetric>& derived_metrics() const
+    {
+        return derived_metrics_;
+    }
+
+    // If set, only the derived metrics are written instead of the values of the metric events
+    bool derived_metrics_only() const
+    {
+        return derived_metrics_only_;
+    }
+
     std::vector<std::string> get_tracepoint_event_names();
 
 private:
+    void partition_group_counters();
+
     std::optional<Event> group_leader_;
     std::vector<Event> group_events_;
+    // Index of the group each of group_events_ is opened in, see partition_group_counters()
+    std::vector<std::size_t> group_event_groups_;
+    std::vector<DerivedMetric> derived_metrics_;
+    bool derived_metrics_only_ = false;
     std::vector<Event> userspace_events_;
     std::vector<tracepoint::TracepointEvent> tracepoint_events_;
 };
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace lo2s
+{
+namespace perf
+{
+namespace counter
+{
+// A metric computed from the metric events, e.g. "ipc=instructions/cpu-cycles". It is evaluated
+// for every sample of the metric leader, using how much each event counted since the previous
+// sample.
+//
+// Expressions consist of event names, numbers, "time" (the seconds since the previous sample),
+// the operators + - * / and parentheses. As event names may contain '-', a subtraction has to be
+// surrounded by spaces.
+class DerivedMetric
+{
+public:
+    class InvalidExpression : public std::runtime_error
+    {
+    public:
+        InvalidExpression(const std::string& definition, const std::string& reason)
+        : std::runtime_error("Invalid derived metric '" + definition + "': " + reason)
+        {
+        }
+    };
+
+    static constexpr const char* TIME = "time";
+
+    // Parses a definition of the form NAME=EXPRESSION
+    DerivedMetric(const std::string& definition);
+
+    const std::string& name() const
+    {
+        return name_;
+    }
+
+    // The names used in the expression, in the order evaluate() expects their values
+    const std::vector<std::string>& operands() const
+    {
+        return operands_;
+    }
+
+    // Non-finite results, e.g. for intervals in which a divisor did not count, are reported as 0
+    double evaluate(const std::vector<double>& operand_values) const;
+
+private:
+    struct Instruction
+    {
+        enum class Type
+        {
+            CONSTANT,
+            OPERAND,
+            ADD,
+            SUBTRACT,
+            MULTIPLY,
+            DIVIDE,
+            NEGATE
+        };
+
+        Type type;
+        double constant = 0;
+        std::size_t operand = 0;
+    };
+
+    void parse_sum(const std::string& definition, std::size_t& pos);
+    void parse_product(const std::string& definition, std::size_t& pos);
+    void parse_factor(const std::string& definition, std::size_t& pos);
+
+    std::string name_;
+    std::vector<std::string> operands_;
+    // The expression in postfix order
+    std::vector<Instruction> program_;
+    mutable std::vector<double> stack_;
+};
+} // namespace counter
+} // namespace perf
+} // namespace lo2s
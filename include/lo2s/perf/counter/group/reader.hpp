@@ -25,8 +25,11 @@
 #include <lo2s/perf/counter/group/group_counter_buffer.hpp>
 #include <lo2s/perf/event.hpp>
 #include <lo2s/perf/event_reader.hpp>
+#include <lo2s/perf/shared_buffer_reader.hpp>
 
-#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <vector>
 
 extern "C"
@@ -47,24 +50,41 @@ namespace group
 // This group has a group leader event, which triggers a readout of the other
 // events every --metric-count occurences. The value is then written into a memory-mapped
 // ring buffer, which we read out routinely to get the counter values.
+//
+// If the counters are split into several groups (see CounterCollection::group_starts), every
+// group has its own copy of the leader, whose samples are redirected into the same ring buffer.
 template <class T>
 class Reader : public EventReader<T>
 {
 public:
-    Reader(ExecutionScope scope, bool enable_on_exec);
+    Reader(ExecutionScope scope, bool enable_on_exec, SharedBufferReader* shared_buffer);
 
     struct RecordSampleType
     {
         struct perf_event_header header;
+        uint64_t id;
         uint64_t time;
         struct GroupReadFormat v;
     };
 
 protected:
-    std::optional<EventGuard> counter_leader_;
+    // Index of the group whose leader generated the sample
+    std::size_t group_of(const RecordSampleType* sample) const
+    {
+        std::size_t group = 0;
+        while (group + 1 < leader_ids_.size() && leader_ids_[group] != sample->id)
+        {
+            group++;
+        }
+        return group;
+    }
+
+    std::vector<EventGuard> counter_leaders_;
+    std::vector<uint64_t> leader_ids_;
     std::vector<EventGuard> counters_;
     CounterCollection counter_collection_;
-    GroupCounterBuffer counter_buffer_;
+    // One buffer per group, each with the leader at index 0
+    std::deque<GroupCounterBuffer> counter_buffers_;
 };
 } // namespace group
 } // namespace counter
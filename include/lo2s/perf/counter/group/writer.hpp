@@ -22,11 +22,16 @@
 #pragma once
 
 #include <lo2s/perf/counter/counter_collection.hpp>
+#include <lo2s/perf/counter/derived_metric.hpp>
 #include <lo2s/perf/counter/group/reader.hpp>
 #include <lo2s/perf/counter/metric_writer.hpp>
 #include <lo2s/perf/time/converter.hpp>
 #include <lo2s/trace/trace.hpp>
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 namespace lo2s
 {
 namespace perf
@@ -38,10 +43,25 @@ namespace group
 class Writer : public Reader<Writer>, MetricWriter
 {
 public:
-    Writer(ExecutionScope scope, trace::Trace& trace, bool enable_on_exec);
+    Writer(ExecutionScope scope, trace::Trace& trace, bool enable_on_exec,
+           SharedBufferReader* shared_buffer);
 
     using Reader<Writer>::handle;
     bool handle(const RecordSampleType* sample);
+
+private:
+    std::vector<DerivedMetric> derived_metrics_;
+    // For every derived metric, the index of each of its operands in deltas_
+    std::vector<std::vector<std::size_t>> derived_operands_;
+    std::vector<std::vector<double>> operand_values_;
+
+    // The scaled values of the leader and the counters at the current and the previous sample
+    std::vector<double> current_;
+    std::vector<double> previous_;
+    // The differences between them, followed by the seconds since the previous sample and a 0
+    // that is used for events which are not available in this scope
+    std::vector<double> deltas_;
+    uint64_t previous_time_ = 0;
 };
 } // namespace group
 } // namespace counter
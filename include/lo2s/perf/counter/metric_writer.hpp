@@ -20,6 +20,7 @@
  */
 
 #pragma once
+#include <lo2s/metric/suppressor.hpp>
 #include <lo2s/perf/time/converter.hpp>
 #include <lo2s/trace/trace.hpp>
 #include <lo2s/util.hpp>
@@ -39,7 +40,7 @@ public:
     : time_converter_(time::Converter::instance()), writer_(trace.metric_writer(scope)),
       metric_instance_(trace.metric_instance(trace.perf_metric_class(scope), writer_.location(),
                                              trace.location(scope.scope))),
-      metric_event_(otf2::chrono::genesis(), metric_instance_)
+      metric_event_(otf2::chrono::genesis(), metric_instance_), suppressor_(writer_)
     {
     }
 
@@ -48,6 +49,8 @@ protected:
     otf2::writer::local& writer_;
     otf2::definition::metric_instance metric_instance_;
     otf2::event::metric metric_event_;
+    // Write metric_event_ through this instead of writer_
+    metric::Suppressor suppressor_;
 };
 } // namespace counter
 } // namespace perf
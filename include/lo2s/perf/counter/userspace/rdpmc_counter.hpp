@@ -0,0 +1,189 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/error.hpp>
+#include <lo2s/perf/counter/userspace/userspace_counter_buffer.hpp>
+#include <lo2s/perf/event.hpp>
+#include <lo2s/util.hpp>
+
+#include <atomic>
+#include <utility>
+
+#include <cstdint>
+
+extern "C"
+{
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+}
+
+namespace lo2s
+{
+namespace perf
+{
+namespace counter
+{
+namespace userspace
+{
+
+/**
+ * Reads a counting perf event from its mmapped perf_event_mmap_page instead of with read().
+ *
+ * While the event is scheduled on a PMU counter, the page tells which one, so its value can be
+ * read with rdpmc. This only gives the value of the event if it counts on the CPU the calling
+ * thread currently runs on, i.e. for cpu-wide events read from a thread pinned to that CPU.
+ */
+class RdpmcCounter
+{
+public:
+    RdpmcCounter(const EventGuard& event)
+    {
+        void* page = ::mmap(nullptr, get_page_size(), PROT_READ, MAP_SHARED, event.get_fd(), 0);
+        if (page == MAP_FAILED)
+        {
+            throw_errno();
+        }
+        page_ = static_cast<volatile perf_event_mmap_page*>(page);
+    }
+
+    RdpmcCounter(const RdpmcCounter&) = delete;
+    RdpmcCounter& operator=(const RdpmcCounter&) = delete;
+
+    RdpmcCounter(RdpmcCounter&& other)
+    {
+        std::swap(page_, other.page_);
+    }
+
+    RdpmcCounter& operator=(RdpmcCounter&& other)
+    {
+        std::swap(page_, other.page_);
+        return *this;
+    }
+
+    ~RdpmcCounter()
+    {
+        if (page_ != nullptr)
+        {
+            ::munmap(const_cast<perf_event_mmap_page*>(page_), get_page_size());
+        }
+    }
+
+    /**
+     * Follows the seqlock protocol described in linux/perf_event.h. Returns false if the kernel
+     * does not permit rdpmc for this event, in which case it has to be read with read().
+     */
+    bool read([[maybe_unused]] UserspaceReadFormat& result) const
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        uint32_t seq;
+        uint64_t count, enabled, running, cycles = 0;
+        uint32_t index, time_shift = 0, time_mult = 0;
+        uint64_t time_offset = 0;
+
+        do
+        {
+            seq = page_->lock;
+            barrier();
+
+            if (!page_->cap_user_rdpmc)
+            {
+                return false;
+            }
+
+            enabled = page_->time_enabled;
+            running = page_->time_running;
+            if (page_->cap_user_time)
+            {
+                cycles = rdtsc();
+                time_offset = page_->time_offset;
+                time_mult = page_->time_mult;
+                time_shift = page_->time_shift;
+            }
+
+            // index is 0 while the event is not scheduled on a counter, then offset is the count
+            index = page_->index;
+            count = page_->offset;
+            if (index != 0)
+            {
+                auto width = page_->pmc_width;
+                int64_t pmc = rdpmc(index - 1);
+                pmc <<= 64 - width;
+                pmc >>= 64 - width;
+                count += pmc;
+            }
+
+            barrier();
+        } while (page_->lock != seq);
+
+        // time_enabled and time_running are only updated when the event is scheduled, so add the
+        // time since then
+        if (cycles != 0)
+        {
+            uint64_t quot = cycles >> time_shift;
+            uint64_t rem = cycles & ((uint64_t(1) << time_shift) - 1);
+            uint64_t delta = time_offset + quot * time_mult + ((rem * time_mult) >> time_shift);
+
+            enabled += delta;
+            if (index != 0)
+            {
+                running += delta;
+            }
+        }
+
+        result.value = count;
+        result.time_enabled = enabled;
+        result.time_running = running;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    static void barrier()
+    {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    static uint64_t rdpmc(uint32_t counter)
+    {
+        uint32_t low, high;
+        asm volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+        return low | (static_cast<uint64_t>(high) << 32);
+    }
+
+    static uint64_t rdtsc()
+    {
+        uint32_t low, high;
+        asm volatile("rdtsc" : "=a"(low), "=d"(high));
+        return low | (static_cast<uint64_t>(high) << 32);
+    }
+#endif
+
+    volatile perf_event_mmap_page* page_ = nullptr;
+};
+} // namespace userspace
+} // namespace counter
+} // namespace perf
+} // namespace lo2s
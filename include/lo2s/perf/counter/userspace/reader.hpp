@@ -23,12 +23,16 @@
 
 #include <lo2s/execution_scope.hpp>
 #include <lo2s/perf/counter/counter_collection.hpp>
+#include <lo2s/perf/counter/group/group_counter_buffer.hpp>
+#include <lo2s/perf/counter/userspace/rdpmc_counter.hpp>
 #include <lo2s/perf/counter/userspace/userspace_counter_buffer.hpp>
 #include <lo2s/perf/event_provider.hpp>
 #include <lo2s/trace/trace.hpp>
 
+#include <cstddef>
 #include <cstdint>
 
+#include <memory>
 #include <vector>
 
 #include <cstdlib>
@@ -56,12 +60,31 @@ public:
     }
 
 protected:
+    // Number of counters in the group that starts at counters_[group_starts_[group]]
+    std::size_t group_size(std::size_t group) const
+    {
+        std::size_t end =
+            group + 1 < group_starts_.size() ? group_starts_[group + 1] : counters_.size();
+        return end - group_starts_[group];
+    }
+
+    // Returns false if the counters could not be read with rdpmc on rdpmc_cpu_
+    bool read_rdpmc(std::size_t first, std::size_t count);
+
     CounterCollection counter_collection_;
     UserspaceCounterBuffer counter_buffer_;
     int timer_fd_;
 
+    // The counters are opened as consecutive perf event groups. Each group is read at once
+    // through its leader, counters_[group_starts_[i]].
     std::vector<EventGuard> counters_;
+    std::vector<std::size_t> group_starts_;
+    std::unique_ptr<std::byte[]> group_buf_;
     std::vector<UserspaceReadFormat> data_;
+
+    // Only for cpu scopes, see RdpmcCounter. Empty if the counters can not be mmapped.
+    std::vector<RdpmcCounter> rdpmc_counters_;
+    int rdpmc_cpu_ = -1;
 };
 } // namespace userspace
 } // namespace counter
@@ -86,6 +86,12 @@ public:
      */
     EventGuard open_as_group_leader(ExecutionScope location, int cgroup_fd = -1);
 
+    /**
+     * returns an opened instance of a Event object counting process and all children it creates
+     * from now on, but only while they run on cpu
+     */
+    EventGuard open_inherited(Process process, Cpu cpu);
+
     const Availability& availability() const
     {
         return availability_;
@@ -149,6 +155,13 @@ public:
         attr_.wakeup_watermark = static_cast<uint32_t>(0.8 * mmap_pages * sysconf(_SC_PAGESIZE));
     }
 
+    // Let the kernel write records backwards into the ring buffer, overwriting the oldest
+    // records once it is full. Such buffers are read with EventReader::read_backward()
+    void write_backward()
+    {
+        attr_.write_backward = 1;
+    }
+
     void exclude_kernel(bool exclude_kernel)
     {
         attr_.exclude_kernel = exclude_kernel;
@@ -227,6 +240,7 @@ class EventGuard
 {
 public:
     EventGuard(Event& ev, std::variant<Cpu, Thread> location, int group_fd, int cgroup_fd);
+    EventGuard(Event& ev, Process process, Cpu cpu);
 
     EventGuard() = delete;
     EventGuard(const EventGuard& other) = delete;
@@ -28,6 +28,7 @@
 #include <lo2s/mmap.hpp>
 #include <lo2s/platform.hpp>
 #include <lo2s/shared_memory.hpp>
+#include <lo2s/summary.hpp>
 #include <lo2s/util.hpp>
 
 #include <algorithm>
@@ -37,10 +38,12 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <vector>
 
 extern "C"
 {
 #include <linux/perf_event.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 }
 
@@ -119,6 +122,9 @@ public:
         // struct sample_id sample_id;
     };
 
+    // PERF_RECORD_EXIT has the same layout as PERF_RECORD_FORK
+    using RecordExitType = RecordForkType;
+
     struct RecordSwitchType
     {
         struct perf_event_header header;
@@ -168,6 +174,13 @@ public:
 
     ~EventReader()
     {
+        if (num_batches_ > 0)
+        {
+            Log::debug() << "read " << num_batch_records_ << " records in " << num_batches_
+                         << " batches in event_reader<" << typeid(CRTP).name() << ">.";
+            summary().record_perf_batches(num_batches_, num_batch_records_);
+        }
+
         if (lost_samples > 0)
         {
             Log::warn() << "Lost a total of " << lost_samples << " samples in event_reader<"
@@ -176,15 +189,21 @@ public:
     }
 
 protected:
-    void init_mmap(int fd)
+    // If overwrite is set, the buffer is mapped read-only, which lets the kernel overwrite old
+    // records instead of dropping new ones. Use this for events opened with write_backward and
+    // read them with read_backward()
+    void init_mmap(int fd, bool overwrite = false)
     {
         fd_ = fd;
+        overwrite_ = overwrite;
 
         mmap_pages_ = config().mmap_pages;
+        read_chunk_size_ = config().perf_read_chunk_pages * get_page_size();
 
         try
         {
-            shmem_ = SharedMemory(fd, (mmap_pages_ + 1) * get_page_size());
+            shmem_ = SharedMemory(fd, (mmap_pages_ + 1) * get_page_size(), 0, nullptr,
+                                  overwrite ? PROT_READ : PROT_READ | PROT_WRITE);
         }
         catch (const std::system_error& e)
         {
@@ -199,81 +218,105 @@ protected:
 public:
     void read()
     {
+        assert(!overwrite_);
+
         int64_t read_samples = 0;
-        while (!empty())
-        {
-            auto event_header_p = get();
-            read_samples++;
-            bool stop = false;
-            auto crtp_this = static_cast<CRTP*>(this);
 
-            switch (event_header_p->type)
-            {
-            case PERF_RECORD_MMAP:
-                stop = crtp_this->handle((const RecordMmapType*)event_header_p);
-                break;
-            case PERF_RECORD_MMAP2:
-                stop = crtp_this->handle((const RecordMmap2Type*)event_header_p);
-                break;
-            case PERF_RECORD_SWITCH:
-                stop = crtp_this->handle((const RecordSwitchType*)event_header_p);
-                break;
-            case PERF_RECORD_SWITCH_CPU_WIDE:
-                stop = crtp_this->handle((const RecordSwitchCpuWideType*)event_header_p);
-                break;
-            case PERF_RECORD_THROTTLE: /* fall-through */
-            case PERF_RECORD_UNTHROTTLE:
-                throttle_samples++;
-                break;
-            case PERF_RECORD_LOST:
-            {
-                auto lost = (const RecordLostType*)event_header_p;
-                lost_samples += lost->lost;
-                Log::warn() << "Lost " << lost->lost << " samples during this chunk.";
-                break;
-            }
-#ifdef HAVE_PERF_RECORD_LOST_SAMPLES
-            case PERF_RECORD_LOST_SAMPLES:
+        // We are the only ones writing data_tail, so we can keep track of it locally and only
+        // publish it to the kernel once per batch (or once per chunk, if configured)
+        auto cur_tail = data_tail();
+        bool stop = false;
+        while (!stop)
+        {
+            const auto cur_head = data_head();
+            if (cur_head == cur_tail)
             {
-                auto lost = (const RecordLostSamplesType*)event_header_p;
-                lost_samples += lost->lost;
-                Log::warn() << "Lost " << lost->lost << " samples during this chunk.";
                 break;
             }
-#endif
-            case PERF_RECORD_EXIT:
-                // We might get those as a side effect of time synchronization,
-                // when using HW_BREAKPOINT_COMPAT, so ignore
-                break;
-            case PERF_RECORD_FORK:
-                stop = crtp_this->handle((const RecordForkType*)event_header_p);
-                break;
-            case PERF_RECORD_SAMPLE:
+
+            assert(cur_tail <= cur_head);
+            // Unless there is a serious kernel bug, the kernel will
+            // always throw away
+            // events on overflow and write PERF_RECORD_LOST events
+            assert(cur_head - cur_tail <= data_size());
+
+            auto published_tail = cur_tail;
+            std::size_t batch_records = 0;
+            while (cur_tail != cur_head)
             {
-                // Use CRTP here because the struct type depends on the perf attr
-                using ActualSampleType = typename CRTP::RecordSampleType;
-                stop = crtp_this->handle((const ActualSampleType*)event_header_p);
-                break;
+                auto event_header_p = record_at(cur_tail);
+                assert(cur_tail + event_header_p->size <= cur_head);
+                cur_tail += event_header_p->size;
+                batch_records++;
+
+                stop = static_cast<CRTP*>(this)->handle_record(event_header_p);
+                if (stop)
+                {
+                    break;
+                }
+
+                if (read_chunk_size_ > 0 && cur_tail - published_tail >= read_chunk_size_)
+                {
+                    data_tail(cur_tail);
+                    published_tail = cur_tail;
+                }
             }
-            case PERF_RECORD_COMM:
-                stop = crtp_this->handle((const RecordCommType*)event_header_p);
-                break;
-            default:
-                stop = crtp_this->handle((const RecordUnknownType*)event_header_p);
-            }
-            pop();
-            if (stop)
+            data_tail(cur_tail);
+
+            read_samples += batch_records;
+            num_batches_++;
+            num_batch_records_ += batch_records;
+        }
+        Log::trace() << "read " << read_samples << " samples.";
+    }
+
+    // Reads all records which the kernel has written backwards into the overwritable buffer
+    // since the last call, in the order in which they were written. Records that have been
+    // overwritten in the meantime are lost.
+    void read_backward()
+    {
+        assert(overwrite_);
+
+        pause_output(true);
+
+        // The kernel writes backwards, so data_head points to the newest record, and walking
+        // towards higher addresses from there goes back in time. Stop at the head of the last
+        // readout or when we would run into the records overwritten by the newest ones.
+        const auto cur_head = data_head();
+        backward_records_.clear();
+        for (auto pos = cur_head; pos != backward_head_;)
+        {
+            auto event_header_p = (const struct perf_event_header*)(data() + pos % data_size());
+            if (event_header_p->size == 0 || pos - cur_head + event_header_p->size > data_size())
             {
                 break;
             }
+            backward_records_.push_back(pos);
+            pos += event_header_p->size;
         }
-        Log::trace() << "read " << read_samples << " samples.";
+        backward_head_ = cur_head;
+
+        std::for_each(backward_records_.rbegin(), backward_records_.rend(), [this](auto pos) {
+            static_cast<CRTP*>(this)->handle_record(record_at(pos));
+        });
+
+        pause_output(false);
+
+        if (!backward_records_.empty())
+        {
+            num_batches_++;
+            num_batch_records_ += backward_records_.size();
+        }
+        Log::debug() << "read " << backward_records_.size() << " records backwards.";
     }
 
     void pop()
     {
-        auto* ev = get();
-        data_tail(data_tail() + ev->size);
+        // The header of a record never wraps around the ring buffer, as records are 8-byte
+        // aligned, so there is no need to copy the whole record here just to get its size
+        auto cur_tail = data_tail();
+        auto* ev = (const struct perf_event_header*)(data() + cur_tail % data_size());
+        data_tail(cur_tail + ev->size);
     }
 
     bool empty()
@@ -294,14 +337,86 @@ public:
         // events on overflow and write PERF_RECORD_LOST events
         assert(cur_head - cur_tail <= data_size());
 
+        auto event_header_p = record_at(cur_tail);
+
+        assert(cur_tail + event_header_p->size <= cur_head);
+
+        return event_header_p;
+    }
+
+    // Dispatches a single record to the matching handle() of the CRTP subclass. Readers whose
+    // records arrive in a buffer of another reader get them passed in here, see
+    // SharedBufferReader. Subclasses may hide this to intercept all records.
+    bool handle_record(const perf_event_header* event_header_p)
+    {
+        auto crtp_this = static_cast<CRTP*>(this);
+
+        switch (event_header_p->type)
+        {
+        case PERF_RECORD_MMAP:
+            return crtp_this->handle((const RecordMmapType*)event_header_p);
+        case PERF_RECORD_MMAP2:
+            return crtp_this->handle((const RecordMmap2Type*)event_header_p);
+        case PERF_RECORD_SWITCH:
+            return crtp_this->handle((const RecordSwitchType*)event_header_p);
+        case PERF_RECORD_SWITCH_CPU_WIDE:
+            return crtp_this->handle((const RecordSwitchCpuWideType*)event_header_p);
+        case PERF_RECORD_THROTTLE: /* fall-through */
+        case PERF_RECORD_UNTHROTTLE:
+            throttle_samples++;
+            return false;
+        case PERF_RECORD_LOST:
+        {
+            auto lost = (const RecordLostType*)event_header_p;
+            lost_samples += lost->lost;
+            Log::warn() << "Lost " << lost->lost << " samples during this chunk.";
+            return false;
+        }
+#ifdef HAVE_PERF_RECORD_LOST_SAMPLES
+        case PERF_RECORD_LOST_SAMPLES:
+        {
+            auto lost = (const RecordLostSamplesType*)event_header_p;
+            lost_samples += lost->lost;
+            Log::warn() << "Lost " << lost->lost << " samples during this chunk.";
+            return false;
+        }
+#endif
+        case PERF_RECORD_EXIT:
+            return crtp_this->handle_exit((const RecordExitType*)event_header_p);
+        case PERF_RECORD_FORK:
+            return crtp_this->handle((const RecordForkType*)event_header_p);
+        case PERF_RECORD_SAMPLE:
+        {
+            // Use CRTP here because the struct type depends on the perf attr
+            using ActualSampleType = typename CRTP::RecordSampleType;
+            return crtp_this->handle((const ActualSampleType*)event_header_p);
+        }
+        case PERF_RECORD_COMM:
+            return crtp_this->handle((const RecordCommType*)event_header_p);
+        default:
+            return crtp_this->handle((const RecordUnknownType*)event_header_p);
+        }
+    }
+
+private:
+    void pause_output(bool pause)
+    {
+        if (ioctl(fd_, PERF_EVENT_IOC_PAUSE_OUTPUT, pause ? 1 : 0) == -1)
+        {
+            throw_errno();
+        }
+    }
+
+    // Returns the record starting at the (unwrapped) position tail. Only records which actually
+    // span the wrap-around of the ring buffer are copied, all others are read in place.
+    perf_event_header* record_at(uint64_t tail)
+    {
         auto d = data();
 
-        auto index = cur_tail % data_size();
+        auto index = tail % data_size();
         auto event_header_p = (struct perf_event_header*)(d + index);
         auto len = event_header_p->size;
 
-        assert(cur_tail + len <= cur_head);
-
         // Event spans the wrap-around of the ring buffer
         if (index + len > data_size())
         {
@@ -375,6 +490,14 @@ public:
         return false;
     }
 
+    // Not an overload of handle(), as exit records have the same type as fork records
+    bool handle_exit(const RecordExitType*)
+    {
+        // We might get those as a side effect of time synchronization,
+        // when using HW_BREAKPOINT_COMPAT, so ignore
+        return false;
+    }
+
     template <class UNKNOWN_RECORD_TYPE>
     bool handle(const UNKNOWN_RECORD_TYPE* record)
     {
@@ -390,7 +513,17 @@ protected:
     size_t mmap_pages_ = 0;
 
 private:
-    int fd_;
+    // number of bytes after which data_tail is published within a batch, 0 means once per batch
+    uint64_t read_chunk_size_ = 0;
+    std::size_t num_batches_ = 0;
+    std::size_t num_batch_records_ = 0;
+
+    // only used for overwritable buffers
+    bool overwrite_ = false;
+    uint64_t backward_head_ = 0;
+    std::vector<uint64_t> backward_records_;
+
+    int fd_ = -1;
     SharedMemory shmem_;
     std::byte event_copy[PERF_SAMPLE_MAX_SIZE] __attribute__((aligned(8)));
 };
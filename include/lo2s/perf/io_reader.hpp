@@ -69,7 +69,7 @@ struct IoReaderIdentity
     std::optional<tracepoint::TracepointEvent> tracepoint_;
     Cpu cpu;
 
-    tracepoint::TracepointEvent tracepoint()
+    tracepoint::TracepointEvent tracepoint() const
     {
         return tracepoint_.value();
     }
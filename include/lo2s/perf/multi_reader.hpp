@@ -21,10 +21,12 @@
 
 #pragma once
 
+#include <lo2s/config.hpp>
 #include <lo2s/log.hpp>
 #include <lo2s/perf/bio/writer.hpp>
 #include <lo2s/perf/io_reader.hpp>
 #include <lo2s/perf/time/converter.hpp>
+#include <lo2s/summary.hpp>
 #include <lo2s/topology.hpp>
 
 #include <lo2s/trace/trace.hpp>
@@ -33,32 +35,52 @@
 #include <otf2xx/event/metric.hpp>
 #include <otf2xx/writer/local.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
-#include <queue>
-#include <unordered_map>
+#include <limits>
+#include <memory>
+#include <utility>
 #include <vector>
 
+#include <cstddef>
+#include <cstdint>
+
 namespace lo2s
 {
 namespace perf
 {
 
+// Merges the events of all tracepoints of Writer on all cpus into a single, ordered stream.
+//
+// Readers are addressed by their index into readers_, which is also their index into the other
+// per-reader vectors. Events are copied out of the perf buffers into a staging area per reader,
+// which keeps its memory across reads. As every buffer is ordered on its own, the merge only needs
+// a heap holding the next event of every reader with staged events.
 template <class Writer>
 class MultiReader
 {
 public:
-    MultiReader(trace::Trace& trace) : writer_(trace)
+    MultiReader(trace::Trace& trace)
+    : writer_(trace), window_(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  config().block_io_reorder_window)
+                                  .count())
     {
+        auto tracepoints = writer_.get_tracepoints();
         for (const auto& cpu : Topology::instance().cpus())
         {
-            for (auto tp : writer_.get_tracepoints())
+            for (std::size_t tp = 0; tp < tracepoints.size(); tp++)
             {
-                IoReaderIdentity id(tp.name(), cpu);
-                auto reader = readers_.emplace(std::piecewise_construct, std::forward_as_tuple(id),
-                                               std::forward_as_tuple(id));
-                fds_.emplace_back(reader.first->second.fd());
+                readers_.emplace_back(
+                    std::make_unique<IoReader>(IoReaderIdentity(tracepoints[tp].name(), cpu)));
+                tracepoint_of_.emplace_back(tp);
+                fds_.emplace_back(readers_.back()->fd());
             }
         }
+
+        staged_.resize(readers_.size());
+        last_time_.resize(readers_.size(), 0);
+        heap_.reserve(readers_.size());
     }
 
     MultiReader(const MultiReader& other) = delete;
@@ -71,59 +93,63 @@ public:
 public:
     void read()
     {
-        std::priority_queue<ReaderState, std::vector<ReaderState>, std::greater<ReaderState>>
-            earliest_available;
-
-        for (auto& reader : readers_)
-        {
-            if (!reader.second.empty())
-            {
-                earliest_available.push(ReaderState(reader.second.top()->time, reader.first));
-            }
-        }
-
-        while (!earliest_available.empty())
+        for (std::size_t index = 0; index < readers_.size(); index++)
         {
-            auto state = earliest_available.top();
-            earliest_available.pop();
+            auto& reader = *readers_[index];
+            auto& staged = staged_[index];
+            bool was_empty = staged.empty();
 
-            while (!readers_.at(state.identity).empty())
+            while (!reader.empty())
             {
-                auto event = readers_.at(state.identity).top();
-                if (event->time > earliest_available.top().time)
+                auto event = reader.top();
+                if (event->time < newest_time_)
                 {
-                    state.time = event->time;
-                    earliest_available.push(state);
-                    break;
+                    num_reordered_++;
                 }
+                newest_time_ = std::max(newest_time_, event->time);
+                last_time_[index] = std::max(last_time_[index], event->time);
 
-                if (event->time < highest_written_)
-                {
-                    // OTF2 requires strict temporal event ordering. Because we combine multiple
-                    // indepedent perf buffers, we can not guarantee that we will see the events for
-                    // a block device in strict temporal order. In the rare case that we get an
-                    // event with a smaller timestamp than an already written event, we have to just
-                    // drop it.
-                    readers_.at(state.identity).pop();
-                    Log::warn() << "Event loss due to event arriving late!";
-                    continue;
-                }
+                staged.push(event);
+                reader.pop();
+            }
 
-                writer_.write(state.identity, event);
-                highest_written_ = event->time;
-                readers_.at(state.identity).pop();
+            if (was_empty && !staged.empty())
+            {
+                push_heap(staged.front()->time, index);
             }
         }
+
+        // Every buffer on its own is ordered, so no event earlier than the oldest among the most
+        // recent events of all buffers can show up anymore. As idle buffers would hold back
+        // everything, events older than the reorder window are written anyway.
+        uint64_t safe_time = *std::min_element(last_time_.begin(), last_time_.end());
+        if (newest_time_ > window_)
+        {
+            safe_time = std::max(safe_time, newest_time_ - window_);
+        }
+        write_until(safe_time);
     }
 
     void finalize()
     {
         for (auto& reader : readers_)
         {
-            reader.second.stop();
+            reader->stop();
         }
         // Flush the event buffer one last time
         read();
+        write_until(std::numeric_limits<uint64_t>::max());
+        writer_.finalize();
+
+        if (num_late_ > 0)
+        {
+            Log::warn() << "Lost " << num_late_ << " block I/O events, because they arrived later "
+                        << "than the reorder window. Consider increasing "
+                           "--block-io-reorder-window.";
+        }
+        Log::debug() << num_reordered_ << " block I/O events arrived out of order, " << num_late_
+                     << " of them too late";
+        summary().record_late_events(num_reordered_, num_late_);
     }
 
     const std::vector<int>& get_fds() const
@@ -132,30 +158,109 @@ public:
     }
 
 private:
-    struct ReaderState
+    // FIFO of events copied out of a perf buffer. The memory is reused, so that no allocations
+    // happen once it has grown large enough.
+    class StagingBuffer
     {
-        ReaderState(uint64_t time, IoReaderIdentity identity) : time(time), identity(identity)
+    public:
+        bool empty() const
         {
+            return begin_ == data_.size();
         }
 
-        uint64_t time;
-        IoReaderIdentity identity;
-
-        friend bool operator>(const ReaderState& lhs, const ReaderState& rhs)
+        void push(const TracepointSampleType* event)
         {
-            if (lhs.time == rhs.time)
+            if (empty())
             {
-                return lhs.identity > rhs.identity;
+                data_.clear();
+                begin_ = 0;
             }
-            return lhs.time > rhs.time;
+            else if (begin_ > data_.size() / 2)
+            {
+                // Move the remaining events to the front instead of growing further
+                data_.erase(data_.begin(), data_.begin() + begin_);
+                begin_ = 0;
+            }
+
+            auto bytes = reinterpret_cast<const std::byte*>(event);
+            data_.insert(data_.end(), bytes, bytes + event->header.size);
+        }
+
+        TracepointSampleType* front()
+        {
+            return reinterpret_cast<TracepointSampleType*>(data_.data() + begin_);
         }
+
+        void pop()
+        {
+            begin_ += front()->header.size;
+        }
+
+    private:
+        std::vector<std::byte> data_;
+        std::size_t begin_ = 0;
     };
 
+    // Ordered by time, then by reader index to keep the order of equal timestamps stable
+    using HeapEntry = std::pair<uint64_t, std::size_t>;
+
+    void push_heap(uint64_t time, std::size_t index)
+    {
+        heap_.emplace_back(time, index);
+        std::push_heap(heap_.begin(), heap_.end(), std::greater<HeapEntry>());
+    }
+
+    void write_until(uint64_t time)
+    {
+        while (!heap_.empty() && heap_.front().first <= time)
+        {
+            auto index = heap_.front().second;
+            std::pop_heap(heap_.begin(), heap_.end(), std::greater<HeapEntry>());
+            heap_.pop_back();
+
+            auto& staged = staged_[index];
+            auto event = staged.front();
+
+            if (event->time < highest_written_)
+            {
+                // OTF2 requires strict temporal event ordering. If an event shows up after a
+                // later one was written already, despite the reorder window, we have to drop it.
+                num_late_++;
+                Log::debug() << "Event loss due to event arriving late!";
+            }
+            else
+            {
+                writer_.write(tracepoint_of_[index], event);
+                highest_written_ = event->time;
+            }
+
+            staged.pop();
+            if (!staged.empty())
+            {
+                push_heap(staged.front()->time, index);
+            }
+        }
+    }
+
     Writer writer_;
-    std::map<IoReaderIdentity, IoReader> readers_;
+
+    // all indexed by reader
+    std::vector<std::unique_ptr<IoReader>> readers_;
+    // index into Writer::get_tracepoints()
+    std::vector<std::size_t> tracepoint_of_;
+    std::vector<StagingBuffer> staged_;
+    // time of the most recent event seen in each buffer
+    std::vector<uint64_t> last_time_;
+
+    // contains an entry for every reader with staged events
+    std::vector<HeapEntry> heap_;
+
+    uint64_t newest_time_ = 0;
     uint64_t highest_written_ = 0;
-    std::priority_queue<ReaderState, std::vector<ReaderState>, std::greater<ReaderState>>
-        earliest_available_;
+    uint64_t window_;
+
+    std::size_t num_reordered_ = 0;
+    std::size_t num_late_ = 0;
 
     std::vector<int> fds_;
 };
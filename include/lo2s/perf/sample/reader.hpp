@@ -23,6 +23,7 @@
 
 #include <lo2s/perf/event_provider.hpp>
 #include <lo2s/perf/event_reader.hpp>
+#include <lo2s/perf/shared_buffer_reader.hpp>
 #include <lo2s/perf/util.hpp>
 
 #include <lo2s/config.hpp>
@@ -67,6 +68,7 @@ public:
         RecordSampleType& operator=(RecordSampleType&&) = delete;
 
         struct perf_event_header header;
+        uint64_t id;
         uint64_t ip;
         uint32_t pid, tid;
         uint64_t time;
@@ -79,18 +81,35 @@ public:
 protected:
     using EventReader<T>::init_mmap;
 
-    Reader(ExecutionScope scope, bool enable_on_exec) : has_cct_(config().enable_cct)
+    // If inherit_process is valid, scope has to be a cpu. The event then records inherit_process
+    // and all its future children while they run on that cpu.
+    Reader(ExecutionScope scope, bool enable_on_exec, SharedBufferReader* shared_buffer,
+           Process inherit_process = Process::invalid())
+    : has_cct_(config().enable_cct)
     {
         Log::debug() << "initializing event_reader for:" << scope.name()
                      << ", enable_on_exec: " << enable_on_exec;
 
         Event event = EventProvider::instance().create_sampling_event(enable_on_exec);
 
+        if (inherit_process != Process::invalid())
+        {
+            // There is no writer per thread that could tell us about thread creation and exit
+            event.mut_attr().task = 1;
+        }
+
         do
         {
             try
             {
-                event_ = event.open(scope, config().cgroup_fd);
+                if (inherit_process != Process::invalid())
+                {
+                    event_ = event.open_inherited(inherit_process, scope.as_cpu());
+                }
+                else
+                {
+                    event_ = event.open(scope, config().cgroup_fd);
+                }
             }
             catch (const std::system_error& e)
             {
@@ -120,8 +139,16 @@ protected:
         // Exception safe, so much wow!
         try
         {
-            init_mmap(event_.value().get_fd());
-            Log::debug() << "mmap initialized";
+            if (shared_buffer != nullptr)
+            {
+                shared_buffer->add(event_.value(), *static_cast<T*>(this));
+                Log::debug() << "output redirected to shared buffer";
+            }
+            else
+            {
+                init_mmap(event_.value().get_fd(), config().flight_recorder);
+                Log::debug() << "mmap initialized";
+            }
 
             if (!enable_on_exec)
             {
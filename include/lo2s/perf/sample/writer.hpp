@@ -58,7 +58,8 @@ class Writer : public Reader<Writer>
 {
 public:
     Writer(ExecutionScope scope, monitor::MainMonitor& monitor, trace::Trace& trace,
-           bool enable_on_exec);
+           bool enable_on_exec, SharedBufferReader* shared_buffer,
+           Process inherit_process = Process::invalid());
     ~Writer();
 
 public:
@@ -68,6 +69,8 @@ public:
     bool handle(const Reader::RecordCommType* comm);
     bool handle(const Reader::RecordSwitchCpuWideType* context_switch);
     bool handle(const Reader::RecordSwitchType* context_switch);
+    bool handle(const Reader::RecordForkType* fork);
+    bool handle_exit(const Reader::RecordExitType* exit);
 
     void end();
 
@@ -80,6 +83,8 @@ private:
     otf2::chrono::time_point adjust_timepoints(otf2::chrono::time_point tp);
 
     ExecutionScope scope_;
+    // cpu scope recording the threads of one process tree, see Reader
+    bool inherited_;
 
     monitor::MainMonitor& monitor_;
 
@@ -98,6 +103,7 @@ private:
     bool first_event_ = true;
     otf2::chrono::time_point first_time_point_;
     otf2::chrono::time_point last_time_point_;
+    otf2::chrono::time_point next_cctx_hand_off_;
 };
 } // namespace sample
 } // namespace perf
@@ -0,0 +1,132 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/build_config.hpp>
+#include <lo2s/config.hpp>
+#include <lo2s/error.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/perf/event.hpp>
+#include <lo2s/perf/event_provider.hpp>
+#include <lo2s/perf/event_reader.hpp>
+#include <lo2s/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <linux/perf_event.h>
+}
+
+namespace lo2s
+{
+namespace perf
+{
+
+// Reads a single ring buffer per CPU into which the events of the other readers of that CPU are
+// redirected with PERF_EVENT_IOC_SET_OUTPUT, instead of each of them mapping its own buffer.
+//
+// Every record is passed on to the reader whose event produced it, which is found by its
+// PERF_SAMPLE_IDENTIFIER. Thus, all redirected events need PERF_SAMPLE_IDENTIFIER and
+// sample_id_all, and have to use the same clock as the buffer.
+class SharedBufferReader : public EventReader<SharedBufferReader>
+{
+public:
+    SharedBufferReader(Cpu cpu)
+    {
+        // The buffer itself is owned by an event which never generates any records
+#ifdef HAVE_PERF_EVENT_DUMMY
+        Event event = EventProvider::instance().create_event("dummy", PERF_TYPE_SOFTWARE,
+                                                             PERF_COUNT_SW_DUMMY);
+#else
+        Event event = EventProvider::instance().create_event("cpu-clock", PERF_TYPE_SOFTWARE,
+                                                             PERF_COUNT_SW_CPU_CLOCK);
+#endif
+
+        try
+        {
+            buffer_event_ = event.open(cpu);
+        }
+        catch (const std::system_error& e)
+        {
+            Log::error() << "perf_event_open for the shared buffer of " << cpu
+                         << " failed: " << e.what();
+            throw;
+        }
+
+        init_mmap(buffer_event_.value().get_fd());
+        Log::debug() << "shared buffer for " << cpu << " initialized";
+    }
+
+    SharedBufferReader(const SharedBufferReader&) = delete;
+    SharedBufferReader& operator=(const SharedBufferReader&) = delete;
+
+    // Redirects the records of the opened event into this buffer. They are handed to reader,
+    // which therefore must not be moved afterwards.
+    template <class Reader>
+    void add(EventGuard& event, Reader& reader)
+    {
+        event.set_output(buffer_event_.value());
+        targets_.emplace_back(event.get_id(), [&reader](const perf_event_header* record) {
+            return reader.handle_record(record);
+        });
+    }
+
+    bool handle_record(const perf_event_header* record)
+    {
+        auto id = record_id(record);
+        for (const auto& target : targets_)
+        {
+            if (target.first == id)
+            {
+                return target.second(record);
+            }
+        }
+
+        Log::warn() << "shared perf buffer: dropping record of type " << record->type
+                    << " for unknown event id " << id;
+        return false;
+    }
+
+private:
+    static uint64_t record_id(const perf_event_header* record)
+    {
+        // For samples, PERF_SAMPLE_IDENTIFIER comes right after the header, for all other records
+        // it is the last field of the sample_id appended due to sample_id_all
+        if (record->type == PERF_RECORD_SAMPLE)
+        {
+            return *reinterpret_cast<const uint64_t*>(record + 1);
+        }
+        return *reinterpret_cast<const uint64_t*>(reinterpret_cast<const std::byte*>(record) +
+                                                  record->size - sizeof(uint64_t));
+    }
+
+    std::optional<EventGuard> buffer_event_;
+    std::vector<std::pair<uint64_t, std::function<bool(const perf_event_header*)>>> targets_;
+};
+} // namespace perf
+} // namespace lo2s
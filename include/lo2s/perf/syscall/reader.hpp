@@ -25,6 +25,7 @@
 #include <lo2s/log.hpp>
 #include <lo2s/perf/event_provider.hpp>
 #include <lo2s/perf/event_reader.hpp>
+#include <lo2s/perf/shared_buffer_reader.hpp>
 #include <lo2s/perf/tracepoint/format.hpp>
 #include <lo2s/perf/util.hpp>
 #include <lo2s/util.hpp>
@@ -67,13 +68,20 @@ public:
         uint64_t args[6];
     };
 
-    Reader(Cpu cpu) : cpu_(cpu)
+    Reader(Cpu cpu, SharedBufferReader* shared_buffer) : cpu_(cpu)
     {
         tracepoint::TracepointEvent enter_event =
             EventProvider::instance().create_tracepoint_event("raw_syscalls:sys_enter");
         tracepoint::TracepointEvent exit_event =
             EventProvider::instance().create_tracepoint_event("raw_syscalls:sys_exit");
 
+        if (shared_buffer != nullptr)
+        {
+            // needed to tell apart lost records in the shared buffer
+            enter_event.mut_attr().sample_id_all = 1;
+            exit_event.mut_attr().sample_id_all = 1;
+        }
+
         try
         {
             enter_ev_ = enter_event.open(cpu_, config().cgroup_fd);
@@ -85,10 +93,18 @@ public:
             throw_errno();
         }
 
-        init_mmap(enter_ev_.value().get_fd());
-        Log::debug() << "perf_tracepoint_reader mmap initialized";
+        if (shared_buffer != nullptr)
+        {
+            shared_buffer->add(enter_ev_.value(), *static_cast<T*>(this));
+            shared_buffer->add(exit_ev_.value(), *static_cast<T*>(this));
+        }
+        else
+        {
+            init_mmap(enter_ev_.value().get_fd());
+            Log::debug() << "perf_tracepoint_reader mmap initialized";
 
-        exit_ev_.value().set_output(enter_ev_.value());
+            exit_ev_.value().set_output(enter_ev_.value());
+        }
 
         enter_ev_.value().set_syscall_filter(config().syscall_filter);
         exit_ev_.value().set_syscall_filter(config().syscall_filter);
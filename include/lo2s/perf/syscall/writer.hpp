@@ -43,7 +43,7 @@ namespace syscall
 class Writer : public Reader<Writer>
 {
 public:
-    Writer(Cpu cpu, trace::Trace& trace);
+    Writer(Cpu cpu, trace::Trace& trace, SharedBufferReader* shared_buffer);
 
     Writer(const Writer& other) = delete;
 
@@ -0,0 +1,151 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/build_config.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/perf/event.hpp>
+#include <lo2s/perf/event_provider.hpp>
+#include <lo2s/perf/event_reader.hpp>
+#include <lo2s/types.hpp>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+extern "C"
+{
+#include <linux/perf_event.h>
+}
+
+namespace lo2s
+{
+namespace perf
+{
+
+// A thread creation, exit or name change, as reported by the kernel
+struct TaskEvent
+{
+    enum class Type
+    {
+        FORK,
+        EXIT,
+        COMM,
+        EXEC
+    };
+
+    Type type;
+    std::uint64_t time;
+    Process process;
+    Thread thread;
+    // FORK only: the thread that created thread
+    Process parent_process;
+    Thread parent_thread;
+    // COMM and EXEC only
+    std::string comm;
+};
+
+// Reads the fork, exit and comm records of a process and all of its children on one cpu, without
+// the need to stop them like ptrace does. Records are appended to the given vector. Records of
+// different cpus are not ordered, so they have to be sorted by time before they are handled.
+class TaskReader : public EventReader<TaskReader>
+{
+public:
+    TaskReader(Process process, Cpu cpu, std::vector<TaskEvent>& events) : events_(events)
+    {
+#ifdef HAVE_PERF_EVENT_DUMMY
+        Event event = EventProvider::instance().create_event("dummy", PERF_TYPE_SOFTWARE,
+                                                             PERF_COUNT_SW_DUMMY);
+#else
+        Event event = EventProvider::instance().create_event("cpu-clock", PERF_TYPE_SOFTWARE,
+                                                             PERF_COUNT_SW_CPU_CLOCK);
+        event.mut_attr().sample_period = 0;
+#endif
+        event.mut_attr().task = 1;
+        event.mut_attr().comm = 1;
+        event.mut_attr().comm_exec = 1;
+        event.mut_attr().sample_id_all = 1;
+        event.mut_attr().sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME;
+        // There are only few of these records, but we want to hear about them right away
+        event.mut_attr().watermark = 1;
+        event.mut_attr().wakeup_watermark = 1;
+
+        try
+        {
+            event_ = event.open_inherited(process, cpu);
+        }
+        catch (const std::system_error& e)
+        {
+            Log::error() << "perf_event_open for task events of " << process << " on " << cpu
+                         << " failed: " << e.what();
+            throw;
+        }
+
+        init_mmap(event_.value().get_fd());
+        event_.value().enable();
+    }
+
+    TaskReader(const TaskReader&) = delete;
+    TaskReader& operator=(const TaskReader&) = delete;
+
+    using EventReader<TaskReader>::handle;
+
+    bool handle(const RecordForkType* fork)
+    {
+        events_.push_back(TaskEvent{ TaskEvent::Type::FORK, fork->time, Process(fork->pid),
+                                     Thread(fork->tid), Process(fork->ppid),
+                                     Thread(fork->ptid), "" });
+        return false;
+    }
+
+    bool handle_exit(const RecordExitType* exit)
+    {
+        events_.push_back(TaskEvent{ TaskEvent::Type::EXIT, exit->time, Process(exit->pid),
+                                     Thread(exit->tid), Process::invalid(), Thread::invalid(),
+                                     "" });
+        return false;
+    }
+
+    bool handle(const RecordCommType* comm)
+    {
+        // The time is the last field of the sample_id appended due to sample_id_all
+        std::uint64_t time;
+        std::memcpy(&time,
+                    reinterpret_cast<const char*>(comm) + comm->header.size - sizeof(time),
+                    sizeof(time));
+
+        auto type = (comm->header.misc & PERF_RECORD_MISC_COMM_EXEC) ? TaskEvent::Type::EXEC
+                                                                      : TaskEvent::Type::COMM;
+        events_.push_back(TaskEvent{ type, time, Process(comm->pid), Thread(comm->tid),
+                                     Process::invalid(), Thread::invalid(), comm->comm });
+        return false;
+    }
+
+private:
+    std::vector<TaskEvent>& events_;
+    std::optional<EventGuard> event_;
+};
+} // namespace perf
+} // namespace lo2s
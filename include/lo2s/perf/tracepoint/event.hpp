@@ -23,6 +23,8 @@
 #include <lo2s/perf/event.hpp>
 #include <nitro/lang/string.hpp>
 
+#include <string_view>
+
 namespace lo2s
 {
 namespace perf
@@ -78,7 +80,7 @@ public:
     }
 
 private:
-    void parse_format_line(const std::string& line);
+    void parse_format_line(std::string_view line);
 
     const static std::filesystem::path base_path_;
     int id_;
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <lo2s/metric/suppressor.hpp>
 #include <lo2s/perf/tracepoint/format.hpp>
 #include <lo2s/perf/tracepoint/reader.hpp>
 
@@ -63,6 +64,7 @@ private:
     const time::Converter time_converter_;
 
     otf2::event::metric metric_event_;
+    metric::Suppressor suppressor_;
 };
 } // namespace tracepoint
 } // namespace perf
@@ -15,6 +15,9 @@ namespace perf
 int perf_event_paranoid();
 int perf_event_open(struct perf_event_attr* perf_attr, ExecutionScope scope, int group_fd,
                     unsigned long flags, int cgroup_fd = -1);
+// Opens the event for process on cpu. With attr.inherit, this includes all future children.
+int perf_event_open(struct perf_event_attr* perf_attr, Process process, Cpu cpu, int group_fd,
+                    unsigned long flags);
 void perf_warn_paranoid();
 void perf_check_disabled();
 } // namespace perf
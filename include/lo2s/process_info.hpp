@@ -27,6 +27,7 @@
 
 #include <mutex>
 #include <thread>
+#include <utility>
 
 namespace lo2s
 {
@@ -37,6 +38,10 @@ public:
     {
     }
 
+    ProcessInfo(Process p, MemoryMap maps) : process_(p), maps_(std::move(maps))
+    {
+    }
+
     Process process() const
     {
         return process_;
@@ -64,18 +64,19 @@ public:
         return *this;
     }
 
-    SharedMemory(int fd, size_t size, size_t offset = 0, void* location = nullptr) : size_(size)
+    SharedMemory(int fd, size_t size, size_t offset = 0, void* location = nullptr,
+                 int prot = PROT_READ | PROT_WRITE)
+    : size_(size)
     {
         assert(offset % get_page_size() == 0);
 
         if (location == nullptr)
         {
-            addr_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+            addr_ = mmap(nullptr, size, prot, MAP_SHARED, fd, offset);
         }
         else
         {
-            addr_ =
-                mmap(location, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+            addr_ = mmap(location, size, prot, MAP_SHARED | MAP_FIXED, fd, offset);
         }
 
         if (addr_ == MAP_FAILED)
@@ -44,6 +44,11 @@ public:
     void register_process(Process process);
 
     void record_perf_wakeups(std::size_t num_wakeups);
+    void record_perf_batches(std::size_t num_batches, std::size_t num_records);
+    // events that had to be reordered when merging buffers, late ones were dropped nevertheless
+    void record_late_events(std::size_t num_reordered, std::size_t num_late);
+    // time spent merging and resolving the calling contexts at the end of the measurement
+    void record_cctx_merge(std::chrono::steady_clock::duration duration);
 
     void set_exit_code(int exit_code);
     void set_trace_dir(const std::string& trace_dir);
@@ -54,8 +59,13 @@ private:
     Summary();
 
     std::chrono::steady_clock::time_point start_wall_time_;
+    std::chrono::steady_clock::duration cctx_merge_time_;
 
     std::atomic<std::size_t> num_wakeups_;
+    std::atomic<std::size_t> num_perf_batches_;
+    std::atomic<std::size_t> num_perf_batch_records_;
+    std::atomic<std::size_t> num_reordered_events_;
+    std::atomic<std::size_t> num_late_events_;
     std::atomic<std::size_t> thread_count_;
 
     std::set<Process> processes_;
@@ -0,0 +1,123 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/address.hpp>
+#include <lo2s/line_info.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lo2s
+{
+
+// Reads the GNU build-id note of an ELF file as hex string
+std::optional<std::string> read_build_id(const std::string& filename);
+
+/**
+ * On-disk cache of resolved line infos, shared between lo2s runs.
+ *
+ * There is one file per binary in the cache directory, named by the build-id of the binary.
+ * It contains the line infos of the file offsets that were resolved in previous runs, sorted by
+ * offset so that the memory-mapped file can be searched directly:
+ *
+ *   Header | Entry[num_entries] | NUL-terminated strings
+ *
+ * New entries are kept in memory and merged into the file by flush(). Files are replaced by
+ * renaming, so concurrent runs never see partially written files.
+ */
+class SymbolCache
+{
+public:
+    class File
+    {
+    public:
+        File(const std::string& filename);
+        ~File();
+
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        bool empty() const
+        {
+            return num_entries_ == 0;
+        }
+
+        // The dso of the returned line info is always dso, as the same binary may be mapped under
+        // different names
+        std::optional<LineInfo> lookup(Address offset, const std::string& dso);
+
+        // Line infos without a source file are not cached
+        void insert(Address offset, const LineInfo& line_info);
+
+        void write();
+
+    private:
+        struct Header;
+        struct Entry;
+
+        const Entry* entries() const;
+        const char* string(uint32_t offset) const;
+
+        std::mutex mutex_;
+        std::string filename_;
+        void* data_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t num_entries_ = 0;
+
+        std::map<Address, LineInfo> added_;
+    };
+
+    static SymbolCache& instance()
+    {
+        static SymbolCache cache;
+        return cache;
+    }
+
+    // An empty directory disables the cache, which is the default
+    void set_directory(const std::string& directory)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        directory_ = directory;
+    }
+
+    // Returns nullptr if the cache is disabled or the binary has no build-id
+    File* open(const std::string& binary);
+
+    // Writes all new entries to disk
+    void flush();
+
+private:
+    SymbolCache() = default;
+
+    std::mutex mutex_;
+    std::string directory_;
+    // keyed by build-id
+    std::map<std::string, std::unique_ptr<File>> files_;
+};
+} // namespace lo2s
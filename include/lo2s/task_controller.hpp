@@ -0,0 +1,74 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/execution_scope.hpp>
+#include <lo2s/monitor/abstract_process_monitor.hpp>
+#include <lo2s/perf/task_reader.hpp>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <signal.h>
+}
+
+namespace lo2s
+{
+
+// Alternative to ProcessController, which learns about new processes and threads from perf task
+// records instead of ptrace. The monitored processes are never stopped, but the monitors are
+// informed a bit later, i.e. exit_thread() is called after the thread is already gone.
+//
+// Only works for a spawned process, as the perf events are inherited by children created after
+// they were opened.
+class TaskController
+{
+public:
+    // child has to be stopped, run() continues it
+    TaskController(Process child, const std::string& name,
+                   monitor::AbstractProcessMonitor& monitor);
+
+    ~TaskController();
+
+    void run();
+
+private:
+    void read_and_dispatch();
+    void dispatch(const perf::TaskEvent& event, bool defer_unknown_exit);
+
+    const Process first_child_;
+    monitor::AbstractProcessMonitor& monitor_;
+    sighandler_t default_signal_handler_;
+    std::size_t num_wakeups_;
+    ExecutionScopeGroup& groups_;
+
+    std::vector<perf::TaskEvent> events_;
+    std::vector<std::unique_ptr<perf::TaskReader>> readers_;
+    std::set<Thread> known_threads_;
+    // exits of threads whose fork was not read yet, because it is in the buffer of another cpu
+    std::vector<perf::TaskEvent> pending_exits_;
+};
+} // namespace lo2s
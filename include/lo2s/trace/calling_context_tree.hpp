@@ -0,0 +1,190 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lo2s/address.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstdint>
+
+namespace lo2s
+{
+namespace trace
+{
+
+/**
+ * A tree of calling contexts, with one node per distinct chain of instruction pointers.
+ *
+ * Deep call graph recordings reach tens of millions of nodes, so instead of a std::map of children
+ * per node, all nodes live in a single vector and refer to each other by 32-bit indices. The
+ * edges are found through one open-addressing hash table over (parent, ip), which stores only
+ * node indices. The children of a node are additionally chained, in insertion order, so that the
+ * tree can be walked without the hash table.
+ */
+template <typename Value>
+class CallingContextTree
+{
+public:
+    using index_type = uint32_t;
+
+    // The root is never a child, so its index doubles as "no node" in the child chains
+    static constexpr index_type ROOT = 0;
+
+    CallingContextTree(Value root_value)
+    {
+        nodes_.emplace_back(Address(0), ROOT, std::move(root_value));
+    }
+
+    /**
+     * Returns the index of the child of parent for ip. If there is none yet, it is created with
+     * a Value constructed from args. The second member is true if the child was created.
+     */
+    template <typename... Args>
+    std::pair<index_type, bool> emplace(index_type parent, Address ip, Args&&... args)
+    {
+        if ((nodes_.size() + 1) * 2 > slots_.size())
+        {
+            grow();
+        }
+
+        auto slot = find_slot(parent, ip);
+        if (slots_[slot] != ROOT)
+        {
+            return { slots_[slot], false };
+        }
+
+        assert(nodes_.size() < static_cast<index_type>(-1));
+        index_type index = nodes_.size();
+        nodes_.emplace_back(ip, parent, Value(std::forward<Args>(args)...));
+        slots_[slot] = index;
+
+        // Append to the chain of children, so that walks visit them in insertion order
+        auto& parent_node = nodes_[parent];
+        if (parent_node.first_child == ROOT)
+        {
+            parent_node.first_child = index;
+        }
+        else
+        {
+            nodes_[parent_node.last_child].next_sibling = index;
+        }
+        parent_node.last_child = index;
+
+        return { index, true };
+    }
+
+    Address ip(index_type node) const
+    {
+        return nodes_[node].ip;
+    }
+
+    index_type parent(index_type node) const
+    {
+        return nodes_[node].parent;
+    }
+
+    Value& value(index_type node)
+    {
+        return nodes_[node].value;
+    }
+
+    const Value& value(index_type node) const
+    {
+        return nodes_[node].value;
+    }
+
+    index_type first_child(index_type node) const
+    {
+        return nodes_[node].first_child;
+    }
+
+    // Returns ROOT after the last child
+    index_type next_sibling(index_type node) const
+    {
+        return nodes_[node].next_sibling;
+    }
+
+    // Number of nodes, including the root
+    std::size_t size() const
+    {
+        return nodes_.size();
+    }
+
+    std::size_t memory_usage() const
+    {
+        return nodes_.capacity() * sizeof(Node) + slots_.capacity() * sizeof(index_type);
+    }
+
+private:
+    struct Node
+    {
+        Node(Address i, index_type p, Value v) : ip(i), parent(p), value(std::move(v))
+        {
+        }
+
+        Address ip;
+        index_type parent;
+        index_type first_child = ROOT;
+        index_type last_child = ROOT;
+        index_type next_sibling = ROOT;
+        Value value;
+    };
+
+    std::size_t hash(index_type parent, Address ip) const
+    {
+        uint64_t h = (ip.value() ^ (static_cast<uint64_t>(parent) << 32 | parent)) *
+                     0x9e3779b97f4a7c15;
+        return (h ^ (h >> 29)) & (slots_.size() - 1);
+    }
+
+    // Returns the slot holding the child of parent for ip, or the empty slot where it belongs
+    std::size_t find_slot(index_type parent, Address ip) const
+    {
+        for (auto slot = hash(parent, ip);; slot = (slot + 1) & (slots_.size() - 1))
+        {
+            auto index = slots_[slot];
+            if (index == ROOT || (nodes_[index].parent == parent && nodes_[index].ip == ip))
+            {
+                return slot;
+            }
+        }
+    }
+
+    void grow()
+    {
+        slots_.assign(std::max<std::size_t>(16, slots_.size() * 2), ROOT);
+        for (index_type index = 1; index < nodes_.size(); index++)
+        {
+            slots_[find_slot(nodes_[index].parent, nodes_[index].ip)] = index;
+        }
+    }
+
+    std::vector<Node> nodes_;
+    // Indices into nodes_, ROOT marks an empty slot. Kept at most half full.
+    std::vector<index_type> slots_;
+};
+} // namespace trace
+} // namespace lo2s
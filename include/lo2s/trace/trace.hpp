@@ -31,17 +31,24 @@
 #include <lo2s/perf/counter/counter_provider.hpp>
 #include <lo2s/perf/tracepoint/event.hpp>
 #include <lo2s/process_info.hpp>
+#include <lo2s/trace/calling_context_tree.hpp>
 #include <lo2s/trace/reg_keys.hpp>
 #include <lo2s/types.hpp>
 
 #include <otf2xx/otf2.hpp>
 
 #include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <set>
+#include <stdexcept>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace lo2s
 {
@@ -49,38 +56,121 @@ namespace trace
 {
 class MainMonitor;
 
-template <typename RefMap>
-using IpMap = std::map<Address, RefMap>;
+// Local calling context references of a sample writer, indexed by the samples' call chains
+using IpRefTree = CallingContextTree<otf2::definition::calling_context::reference_type>;
+// The global calling context definitions of a thread
+using IpCctxTree = CallingContextTree<otf2::definition::calling_context*>;
 
-struct IpRefEntry
+// The nodes of a thread's IpRefTree that were added since the last hand-off to the calling
+// context merger. Parents always come before their children.
+struct CctxDelta
 {
-    IpRefEntry(otf2::definition::calling_context::reference_type r) : ref(r)
+    struct Node
     {
-    }
+        IpRefTree::index_type index;
+        IpRefTree::index_type parent;
+        Address ip;
+        otf2::definition::calling_context::reference_type ref;
+    };
 
-    otf2::definition::calling_context::reference_type ref;
-    IpMap<IpRefEntry> children;
+    Thread thread;
+    Process process;
+    std::vector<Node> nodes;
 };
 
 struct ThreadCctxRefs
 {
     ThreadCctxRefs(Process p, otf2::definition::calling_context::reference_type r)
-    : process(p), entry(r)
+    : process(p), tree(r)
+    {
+    }
+
+    // The tree only ever grows, so the delta is everything after the last hand-off
+    CctxDelta take_delta(Thread thread)
     {
+        CctxDelta delta{ thread, process, {} };
+        delta.nodes.reserve(tree.size() - handed_off);
+        for (; handed_off < tree.size(); handed_off++)
+        {
+            delta.nodes.push_back(CctxDelta::Node{ handed_off, tree.parent(handed_off),
+                                                   tree.ip(handed_off), tree.value(handed_off) });
+        }
+        return delta;
     }
 
     Process process;
-    IpRefEntry entry;
+    IpRefTree tree;
+    IpRefTree::index_type handed_off = 0;
 };
 
-struct IpCctxEntry
+// Resolves the IPs of a single process while merging calling contexts.
+//
+// ProcessInfo::maps() copies the whole memory map under a lock, so the resolver takes one
+// snapshot for the whole merge. As the same IPs show up in many calling contexts, resolved line
+// infos are memoized as well.
+class IpResolver
 {
-    IpCctxEntry(otf2::definition::calling_context& c) : cctx(c)
+public:
+    IpResolver(const std::map<Process, ProcessInfo>& infos, Process process)
+    {
+        auto info_it = infos.find(process);
+        if (info_it != infos.end())
+        {
+            maps_ = info_it->second.maps();
+        }
+    }
+
+    bool has_maps() const
+    {
+        return maps_.has_value();
+    }
+
+    // False if the snapshot has no mapping for ip (yet)
+    bool is_mapped(Address ip) const
+    {
+        return maps_ && maps_->is_mapped(ip);
+    }
+
+    const LineInfo& lookup_line_info(Address ip)
+    {
+        auto it = line_infos_.find(ip);
+        if (it != line_infos_.end())
+        {
+            return it->second;
+        }
+
+        return line_infos_.emplace(ip, resolve(ip)).first->second;
+    }
+
+    // Resolves ip without memoizing it. Only reads the snapshot, so this can be called
+    // concurrently.
+    LineInfo resolve(Address ip) const
+    {
+        if (!maps_)
+        {
+            return LineInfo::for_unknown_function();
+        }
+        return maps_->lookup_line_info(ip);
+    }
+
+    void memoize(Address ip, const LineInfo& line_info)
     {
+        line_infos_.emplace(ip, line_info);
     }
 
-    otf2::definition::calling_context& cctx;
-    IpMap<IpCctxEntry> children;
+    // Will throw alot - catch it if you can
+    std::string lookup_instruction(Address ip) const
+    {
+        if (!maps_)
+        {
+            throw std::domain_error("Unknown process.");
+        }
+        return maps_->lookup_instruction(ip);
+    }
+
+private:
+    std::optional<MemoryMap> maps_;
+    std::map<Address, LineInfo> line_infos_;
 };
 
 /*
@@ -96,10 +186,21 @@ struct ThreadCctxRefMap
     std::atomic<size_t> ref_count;
 
     using value_type = std::map<Thread, ThreadCctxRefs>::value_type;
-};
 
-using IpRefMap = IpMap<IpRefEntry>;
-using IpCctxMap = IpMap<IpCctxEntry>;
+    // Merge state, only touched by whoever merges the handed off deltas
+    struct MergedThread
+    {
+        // Global node for each local node, PENDING while it is not merged
+        std::vector<IpCctxTree::index_type> global_nodes;
+        // Nodes whose IP was not mapped yet, and their descendants
+        std::vector<CctxDelta::Node> pending;
+    };
+
+    static constexpr IpCctxTree::index_type PENDING = -1;
+
+    std::map<Thread, MergedThread> merged;
+    std::vector<uint32_t> mappings;
+};
 
 class Trace
 {
@@ -125,9 +226,11 @@ public:
     void update_thread_name(Thread t, const std::string& name);
 
     ThreadCctxRefMap& create_cctx_refs();
-    otf2::definition::mapping_table
-    merge_calling_contexts(const std::map<Thread, ThreadCctxRefs>& new_ips, size_t num_ip_refs,
-                           const std::map<Process, ProcessInfo>& infos);
+    // Starts merging the calling contexts handed off by the writers during the measurement.
+    // process_infos_mutex must be held while inserting into process_infos.
+    void start_cctx_merger(const std::map<Process, ProcessInfo>& process_infos,
+                           std::mutex& process_infos_mutex);
+    void hand_off_calling_contexts(ThreadCctxRefMap& refs, std::vector<CctxDelta> deltas);
     void merge_calling_contexts(const std::map<Process, ProcessInfo>& process_infos);
 
     otf2::definition::mapping_table merge_syscall_contexts(const std::set<int64_t>& used_syscalls);
@@ -245,17 +348,24 @@ public:
             ByCounterCollection(counter_collection), otf2::common::metric_occurence::async,
             otf2::common::recorder_kind::abstract);
 
-        if (scope.type == MeasurementScopeType::GROUP_METRIC)
+        const auto& counter_provider = perf::counter::CounterProvider::instance();
+        bool write_events = scope.type != MeasurementScopeType::GROUP_METRIC ||
+                            !counter_provider.derived_metrics_only();
+
+        if (scope.type == MeasurementScopeType::GROUP_METRIC && write_events)
         {
             metric_class.add_member(get_event_metric_member(counter_collection.leader()));
         }
 
-        for (const auto& counter : counter_collection.counters)
+        if (write_events)
         {
-            metric_class.add_member(get_event_metric_member(counter));
+            for (const auto& counter : counter_collection.counters)
+            {
+                metric_class.add_member(get_event_metric_member(counter));
+            }
         }
 
-        if (scope.type == MeasurementScopeType::GROUP_METRIC)
+        if (scope.type == MeasurementScopeType::GROUP_METRIC && write_events)
         {
             auto& enabled_metric_member = registry_.emplace<otf2::definition::metric_member>(
                 ByString("time_enabled"), intern("time_enabled"), intern("time event active"),
@@ -271,6 +381,20 @@ public:
 
             metric_class.add_member(running_metric_member);
         }
+
+        if (scope.type == MeasurementScopeType::GROUP_METRIC)
+        {
+            for (const auto& metric : counter_provider.derived_metrics())
+            {
+                auto& member = registry_.emplace<otf2::definition::metric_member>(
+                    ByString("derived_metric:" + metric.name()), intern(metric.name()),
+                    intern("derived metric " + metric.name()), otf2::common::metric_type::other,
+                    otf2::common::metric_mode::absolute_last, otf2::common::type::Double,
+                    otf2::common::base_type::decimal, 0, intern(""));
+
+                metric_class.add_member(member);
+            }
+        }
         return metric_class;
     }
 
@@ -344,9 +468,24 @@ private:
     void add_thread_exclusive(Thread thread, const std::string& name,
                               const std::lock_guard<std::recursive_mutex>&);
 
-    void merge_ips(const IpRefMap& new_children, IpCctxMap& children,
-                   std::vector<uint32_t>& mapping_table, otf2::definition::calling_context& parent,
-                   const std::map<Process, ProcessInfo>& infos, Process p);
+    IpCctxTree& thread_calling_context_tree(Thread thread, Process process);
+
+    // Puts the pending nodes of the delta's thread in front of it, as they are older
+    static void prepend_pending(ThreadCctxRefMap& refs, CctxDelta& delta);
+
+    // Merges delta into the global tree of its thread and records the mappings in refs. Unless
+    // final, nodes whose IP is not mapped yet are kept pending for a later merge.
+    void merge_cctx_delta(ThreadCctxRefMap& refs, CctxDelta& delta, IpResolver& resolver,
+                          bool final);
+
+    // Resolves all IPs of the deltas concurrently and memoizes them in resolvers
+    void resolve_ips(const std::vector<std::pair<ThreadCctxRefMap*, CctxDelta>>& deltas,
+                     const std::map<Process, ProcessInfo>& infos,
+                     std::map<Process, IpResolver>& resolvers);
+
+    void cctx_merger_main(const std::map<Process, ProcessInfo>& process_infos,
+                          std::mutex& process_infos_mutex);
+    void stop_cctx_merger();
 
     const otf2::definition::system_tree_node bio_parent_node(BlockDevice& device)
     {
@@ -394,7 +533,7 @@ private:
     // TODO add location groups (processes), read path from /proc/self/exe symlink
 
     std::map<Thread, std::string> thread_names_;
-    std::map<Thread, IpCctxEntry> calling_context_tree_;
+    std::map<Thread, IpCctxTree> calling_context_tree_;
 
     otf2::definition::comm_locations_group& comm_locations_group_;
     otf2::definition::comm_locations_group& hardware_comm_locations_group_;
@@ -420,6 +559,13 @@ private:
     std::mutex cctx_refs_mutex_;
     // I wanted to use atomic_flag, but I need test and that's a C++20 exclusive.
     std::atomic_bool cctx_refs_finalized_ = false;
+
+    // Deltas handed off during the measurement, see start_cctx_merger()
+    std::thread cctx_merger_;
+    std::mutex cctx_merge_mutex_;
+    std::condition_variable cctx_merge_cv_;
+    std::vector<std::pair<ThreadCctxRefMap*, CctxDelta>> cctx_merge_queue_;
+    bool cctx_merger_stop_ = false;
 };
 } // namespace trace
 } // namespace lo2s
@@ -30,6 +30,7 @@
 #include <fstream>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -70,14 +71,27 @@ public:
         return l;
     }
 
+    // Elements are constructed outside of the lock, so that threads opening different binaries do
+    // not wait for each other
     T& operator[](const std::string& name)
     {
-        std::lock_guard<std::mutex> guard(mutex_);
-        return elements_.try_emplace(name, name).first->second;
+        Element* element;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            element = &elements_[name];
+        }
+        std::call_once(element->once, [element, &name]() { element->value.emplace(name); });
+        return *element->value;
     }
 
 private:
-    std::unordered_map<std::string, T> elements_;
+    struct Element
+    {
+        std::once_flag once;
+        std::optional<T> value;
+    };
+
+    std::unordered_map<std::string, Element> elements_;
     std::mutex mutex_;
 };
 
@@ -109,6 +123,8 @@ T get_sysctl(const std::string& group, const std::string& name)
 
 int32_t get_task_last_cpu_id(std::istream& proc_stat);
 
+std::vector<Process> get_running_processes();
+std::unordered_map<Thread, std::string> get_comms_for_process(Process process);
 std::unordered_map<Thread, std::string> get_comms_for_running_threads();
 
 void try_pin_to_scope(ExecutionScope scope);
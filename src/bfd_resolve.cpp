@@ -22,7 +22,9 @@
 #include <lo2s/bfd_resolve.hpp>
 #include <lo2s/log.hpp>
 
+#include <algorithm>
 #include <filesystem>
+#include <iterator>
 
 #include <system_error>
 
@@ -95,60 +97,57 @@ Lib::Lib(const std::string& name)
     //            }
 
     read_symbols();
-    read_sections();
+    read_functions();
+
+    // Stripped binaries may still have line info in separate debug files (e.g. in /usr/lib/debug),
+    // which BFD finds through the debug link or the build-id
+    has_line_info_ = false;
+    for (const char* section : { ".debug_line", ".gnu_debuglink", ".gnu_debugaltlink",
+                                 ".note.gnu.build-id" })
+    {
+        if (bfd_get_section_by_name(handle_.get(), section) != nullptr)
+        {
+            has_line_info_ = true;
+            break;
+        }
+    }
+}
+
+const Lib::Function& Lib::lookup_function(Address addr) const
+{
+    auto it = std::upper_bound(functions_.begin(), functions_.end(), addr,
+                               [](Address addr, const Function& f) { return addr < f.start; });
+    if (it == functions_.begin() || !(addr < std::prev(it)->end))
+    {
+        // unfortunately this happens often, so it's only debug
+        Log::debug() << "could not find function for " << addr << " in " << name_;
+        throw LookupError("could not find function", addr);
+    }
+    return *std::prev(it);
 }
 
 LineInfo Lib::lookup(Address addr) const
 {
+    const auto& function = lookup_function(addr);
+
     const char* file = nullptr;
-    const char* func = nullptr;
     unsigned int line = 0;
-
-    try
+    if (has_line_info_)
     {
-        auto section = sections_.at(addr);
         // VMA is useless for shared libraries, we remove the offset from the map
         // so use filepos instead
-        // auto base = bfd_get_section_vma(handle_, section);
-        auto base = section->filepos;
-        auto size = bfd_get_section_size(section);
-        auto local_addr = addr - base;
-        if (local_addr >= base + size)
-        {
-            // This should not happen as long as we lookup sections in the range-map by
-            // address, since base/size is the same as used for the ranges
-            Log::error() << "address " << addr << " out of section bounds " << name_ << " "
-                         << bfd_get_section_name(handle_.get(), section) << " filepos: " << hex
-                         << base << ", size: " << hex << size;
-            throw LookupError("address out of .symtab bounds", addr);
-        }
+        auto local_addr = addr - function.section->filepos;
         auto evil_symtab = const_cast<asymbol**>(symbols_.data());
-        auto found = bfd_find_nearest_line(handle_.get(), section, evil_symtab, local_addr.value(),
-                                           &file, &func, &line);
-        if (!found)
+        const char* func = nullptr;
+        if (!bfd_find_nearest_line(handle_.get(), function.section, evil_symtab,
+                                   local_addr.value(), &file, &func, &line))
         {
-            Log::debug() << "bfd_find_nearest_line failed " << addr << " in " << name_
-                         << bfd_get_section_name(handle_.get(), section);
-            throw LookupError("bfd_find_nearest_line failed", addr);
+            Log::debug() << "bfd_find_nearest_line failed " << addr << " in " << name_;
+            file = nullptr;
+            line = 0;
         }
-        if (func != nullptr)
-        {
-            unique_char_ptr demangled(bfd_demangle(handle_.get(), func, DMGL_PARAMS | DMGL_ANSI));
-            if (demangled)
-            {
-                LineInfo line_info = LineInfo::for_function(file, demangled.get(), line, name_);
-                return line_info;
-            }
-        }
-        return LineInfo::for_function(file, func, line, name_);
-    }
-    catch (std::out_of_range&)
-    {
-        // TODO handle better
-        // unfortunately this happens often, so it's only debug
-        Log::debug() << "could not find section for " << addr << " in " << name_;
-        throw LookupError("could not find section", addr);
     }
+    return LineInfo::for_function(file, function.name->c_str(), line, name_);
 }
 
 void Lib::read_symbols()
@@ -191,11 +190,8 @@ void Lib::read_symbols()
     }
 }
 
-void Lib::read_sections()
+void Lib::read_functions()
 {
-    // We could read *all* sections using bfd_map_ver_sections, however some sections are
-    // overlapping :-(, so we couldn't put them in our range-map. So instead use only the
-    // sections that are referenced by a function symbol.
     for (auto sym : symbols_)
     {
         if (sym == nullptr || !(sym->flags & BSF_FUNCTION))
@@ -203,38 +199,41 @@ void Lib::read_sections()
             continue;
         }
         auto section = sym->section;
-        if (bfd_is_und_section(section))
+        if (bfd_is_und_section(section) || bfd_get_section_size(section) == 0)
         {
             continue;
         }
+
         // VMA is useless for shared libraries, we remove the offset from the map
         // so use filepos instead
-        // auto start = bfd_get_section_vma(handle_, section);
-        auto start = section->filepos;
-        auto size = bfd_get_section_size(section);
-        if (size == 0)
-        {
-            Log::debug() << "skipping empty section: "
-                         << bfd_get_section_name(handle_.get(), section);
-            continue;
-        }
-        try
-        {
-            auto r = sections_.emplace(std::piecewise_construct,
-                                       std::forward_as_tuple(start, start + size),
-                                       std::forward_as_tuple(section));
-            if (r.second)
-            {
-                Log::trace() << "Added section: " << bfd_get_section_name(handle_.get(), section)
-                             << " from symbol " << sym->name;
-            }
-        }
-        catch (Range::Error& e)
+        Address start = section->filepos + sym->value;
+        Address section_end = section->filepos + bfd_get_section_size(section);
+
+        unique_char_ptr demangled(bfd_demangle(handle_.get(), sym->name, DMGL_PARAMS | DMGL_ANSI));
+        const std::string* name = intern(demangled ? demangled.get() : sym->name);
+        functions_.push_back(Function{ start, section_end, section, name });
+    }
+
+    // Aliases share the same start address, keep only one of them
+    std::stable_sort(functions_.begin(), functions_.end(),
+                     [](const Function& a, const Function& b) { return a.start < b.start; });
+    functions_.erase(std::unique(functions_.begin(), functions_.end(),
+                                 [](const Function& a, const Function& b) {
+                                     return a.start == b.start;
+                                 }),
+                     functions_.end());
+
+    // The symbol sizes are not available through the generic BFD API, so every function ends
+    // where the next one in the same section starts
+    for (std::size_t i = 0; i + 1 < functions_.size(); i++)
+    {
+        if (functions_[i + 1].start < functions_[i].end)
         {
-            Log::warn() << "failed to add section " << bfd_get_section_name(handle_.get(), section)
-                        << "due to " << e.what();
+            functions_[i].end = functions_[i + 1].start;
         }
     }
+
+    Log::debug() << "indexed " << functions_.size() << " functions in " << name_;
 }
 } // namespace bfdr
 } // namespace lo2s
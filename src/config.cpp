@@ -165,6 +165,7 @@ void parse_program_options(int argc, const char** argv)
     auto& sensors_options = parser.group("sensors options");
     auto& io_options = parser.group("I/O recording options");
     auto& accel_options = parser.group("Accelerator options");
+    auto& flight_recorder_options = parser.group("Flight recorder options");
 
     lo2s::Config config;
 
@@ -201,6 +202,33 @@ void parse_program_options(int argc, const char** argv)
         .default_value("16")
         .metavar("PAGES");
 
+    general_options
+        .option("perf-read-chunk",
+                "Number of pages after which read perf buffer space is handed back to the "
+                "kernel. If 0, it is handed back once per read batch.")
+        .default_value("0")
+        .metavar("PAGES");
+
+    general_options.toggle(
+        "reader-pool",
+        "Read the perf buffers of all monitored threads using a fixed pool of threads instead of "
+        "one monitoring thread per monitored thread.");
+
+    general_options
+        .option("reader-pool-size",
+                "Number of threads in the reader pool. If 0, a quarter of the number of CPUs.")
+        .default_value("0")
+        .metavar("THREADS");
+
+    general_options.toggle(
+        "per-cpu-inherit",
+        "Record sampling and context switch events of COMMAND and all its children with one "
+        "inherited perf event per CPU instead of one per thread.");
+
+    general_options.toggle("no-ptrace",
+                           "Track the processes and threads of COMMAND using perf task events "
+                           "instead of ptrace, which does not stop them on every fork or clone.");
+
     general_options
         .option("readout-interval", "Time in milliseconds between readouts of interval based "
                                     "monitors, i.e. x86_adapt, x86_energy.")
@@ -238,6 +266,10 @@ void parse_program_options(int argc, const char** argv)
                                      "Shorthand for \"-a --instruction-sampling\".")
         .short_name("A");
 
+    system_mode_options.toggle(
+        "shared-perf-buffer",
+        "Use a single perf buffer per CPU for sampling, metric and syscall events.");
+
     system_mode_options
         .option("cgroup",
                 "Only record perf events for the given cgroup. Can only be used in system-mode")
@@ -275,6 +307,31 @@ void parse_program_options(int argc, const char** argv)
 #endif
         .allow_reverse();
 
+    sampling_options
+        .toggle("symbol-cache",
+                "Cache resolved symbols on disk to speed up later measurements of the same "
+                "binaries.")
+        .allow_reverse();
+
+    sampling_options.toggle("defer-symbols",
+                            "Do not resolve symbols of user space binaries at the end of the "
+                            "measurement, but leave that to lo2s-resolve.");
+
+    sampling_options
+        .option("cctx-merge-interval",
+                "Time in milliseconds between merges of new calling contexts in the background. "
+                "If not provided, calling contexts are only merged at the end of the "
+                "measurement.")
+        .optional()
+        .metavar("MSEC");
+
+    sampling_options
+        .option("symbol-cache-dir",
+                "Directory of the symbol cache, implies --symbol-cache (default: "
+                "$XDG_CACHE_HOME/lo2s or ~/.cache/lo2s).")
+        .metavar("DIR")
+        .optional();
+
     sampling_options.toggle("kernel", "Include events happening in kernel space.")
         .allow_reverse()
         .default_value(true);
@@ -325,6 +382,37 @@ void parse_program_options(int argc, const char** argv)
         .metavar("HZ")
         .default_value("10");
 
+    perf_metric_options
+        .option("metric-keyframe-interval",
+                "Drop metric events whose values did not change since the last written event, "
+                "but write at least every N-th event. 0 disables dropping events.")
+        .metavar("N")
+        .default_value("0");
+
+    perf_metric_options
+        .option("metric-suppression-epsilon",
+                "Relative change of a metric value below which it counts as unchanged for "
+                "--metric-keyframe-interval.")
+        .metavar("EPS")
+        .default_value("0");
+
+    perf_metric_options
+        .option("metric-suppression-absolute",
+                "Absolute change of a metric value below which it counts as unchanged for "
+                "--metric-keyframe-interval.")
+        .metavar("EPS")
+        .default_value("0");
+
+    perf_metric_options
+        .multi_option("derived-metric",
+                      "Record a metric computed from the --metric-event values between two "
+                      "samples, e.g. ipc=instructions/cpu-cycles")
+        .optional()
+        .metavar("NAME=EXPR");
+
+    perf_metric_options.toggle("derived-metrics-only",
+                               "Only record the --derived-metric values, not the metric events.");
+
     perf_metric_options
         .multi_option("syscall",
                       "Record syscall events for given syscall. \"all\" to record all syscalls")
@@ -346,6 +434,27 @@ void parse_program_options(int argc, const char** argv)
     io_options.toggle("block-io",
                       "Enable recording of block I/O events (requires access to debugfs)");
 
+    io_options
+        .option("block-io-reorder-window",
+                "Time in milliseconds block I/O events are held back to bring the events of "
+                "different CPUs into order.")
+        .default_value("10")
+        .metavar("MSEC");
+
+    io_options.toggle("block-io-histogram",
+                      "Instead of recording every block I/O request, record histograms of the "
+                      "request latencies and sizes per device every readout interval.");
+
+    flight_recorder_options.toggle(
+        "flight-recorder", "Keep samples and metrics in overwritable buffers and only write the "
+                           "most recent ones to the trace when triggered, e.g. by SIGUSR1.");
+
+    flight_recorder_options
+        .option("flight-recorder-trigger-file",
+                "Trigger the flight recorder whenever FILE is created. FILE is removed afterwards.")
+        .metavar("FILE")
+        .optional();
+
     std::vector<std::string> accelerators;
 
 #ifdef HAVE_CUDA
@@ -397,16 +506,20 @@ void parse_program_options(int argc, const char** argv)
     config.trace_path = arguments.get("output-trace");
     config.quiet = arguments.given("quiet");
     config.mmap_pages = arguments.as<std::size_t>("mmap-pages");
+    config.perf_read_chunk_pages = arguments.as<std::size_t>("perf-read-chunk");
     config.process =
         arguments.provided("pid") ? Process(arguments.as<pid_t>("pid")) : Process::invalid();
     config.drop_root = arguments.given("drop-root");
+    config.use_ptrace = !arguments.given("no-ptrace");
     config.sampling_event = arguments.get("event");
     config.sampling_period = arguments.as<std::uint64_t>("count");
     config.enable_cct = arguments.given("call-graph");
     config.suppress_ip = arguments.given("no-ip");
+    config.defer_symbols = arguments.given("defer-symbols");
     config.use_x86_energy = arguments.given("x86-energy");
     config.use_sensors = arguments.given("sensors");
-    config.use_block_io = arguments.given("block-io");
+    config.block_io_histogram = arguments.given("block-io-histogram");
+    config.use_block_io = arguments.given("block-io") || config.block_io_histogram;
 
 #ifdef HAVE_CUDA
     config.cuda_injectionlib_path = arguments.get("nvidia-injection-path");
@@ -619,6 +732,22 @@ void parse_program_options(int argc, const char** argv)
             }
         }
 
+        config.shared_perf_buffer = arguments.given("shared-perf-buffer");
+
+        if (arguments.given("reader-pool"))
+        {
+            Log::fatal() << "--reader-pool can only be used in process monitoring mode";
+            std::exit(EXIT_FAILURE);
+        }
+        config.reader_pool_size = 0;
+
+        if (arguments.given("per-cpu-inherit"))
+        {
+            Log::fatal() << "--per-cpu-inherit can only be used in process monitoring mode";
+            std::exit(EXIT_FAILURE);
+        }
+        config.per_cpu_inherit = false;
+
         if (arguments.provided("syscall"))
         {
             std::vector<std::string> requested_syscalls = arguments.get_all("syscall");
@@ -644,7 +773,34 @@ void parse_program_options(int argc, const char** argv)
             Log::fatal() << "Syscall recording is only available in system-wide monitoring mode";
             std::exit(EXIT_FAILURE);
         }
+
+        if (arguments.given("shared-perf-buffer"))
+        {
+            Log::fatal() << "--shared-perf-buffer can only be used in system-wide monitoring mode";
+            std::exit(EXIT_FAILURE);
+        }
+        config.shared_perf_buffer = false;
         config.monitor_type = lo2s::MonitorType::PROCESS;
+
+        config.reader_pool_size = 0;
+        if (arguments.given("reader-pool"))
+        {
+            config.reader_pool_size = arguments.as<std::size_t>("reader-pool-size");
+            if (config.reader_pool_size == 0)
+            {
+                config.reader_pool_size =
+                    std::max<std::size_t>(1, Topology::instance().cpus().size() / 4);
+            }
+        }
+
+        config.per_cpu_inherit = arguments.given("per-cpu-inherit");
+        if (config.per_cpu_inherit && config.process != Process::invalid())
+        {
+            // Inherited events only cover children created after they were opened, but not the
+            // already running threads of the process.
+            Log::fatal() << "--per-cpu-inherit can not be used with --pid";
+            std::exit(EXIT_FAILURE);
+        }
         config.sampling = true;
 
         if (!arguments.given("instruction-sampling"))
@@ -653,6 +809,12 @@ void parse_program_options(int argc, const char** argv)
         }
     }
 
+    if (!config.use_ptrace && config.process != Process::invalid())
+    {
+        Log::fatal() << "--no-ptrace can only be used when lo2s starts COMMAND";
+        std::exit(EXIT_FAILURE);
+    }
+
     if (config.monitor_type == lo2s::MonitorType::PROCESS && config.process == Process::invalid() &&
         config.command.empty())
     {
@@ -717,18 +879,53 @@ void parse_program_options(int argc, const char** argv)
     config.userspace_read_interval =
         std::chrono::milliseconds(arguments.as<std::uint64_t>("userspace-readout-interval"));
 
+    config.block_io_reorder_window =
+        std::chrono::milliseconds(arguments.as<std::uint64_t>("block-io-reorder-window"));
+
     config.nec_read_interval =
         std::chrono::microseconds(arguments.as<std::uint64_t>("nec-readout-interval"));
 
     config.nec_check_interval =
         std::chrono::milliseconds(arguments.as<std::uint64_t>("nec-check-interval"));
 
+    if (arguments.provided("cctx-merge-interval"))
+    {
+        config.cctx_merge_interval =
+            std::chrono::milliseconds(arguments.as<std::uint64_t>("cctx-merge-interval"));
+    }
+
     if (arguments.provided("perf-readout-interval"))
     {
         config.perf_read_interval =
             std::chrono::milliseconds(arguments.as<std::uint64_t>("perf-readout-interval"));
     }
 
+    config.flight_recorder = arguments.given("flight-recorder");
+    if (arguments.provided("flight-recorder-trigger-file"))
+    {
+        if (!config.flight_recorder)
+        {
+            Log::fatal() << "--flight-recorder-trigger-file can only be used in conjunction with "
+                            "--flight-recorder";
+            std::exit(EXIT_FAILURE);
+        }
+        config.flight_recorder_trigger_file = arguments.get("flight-recorder-trigger-file");
+    }
+
+    // Overwritable buffers can not be shared with the syscall events
+    if (config.flight_recorder && config.shared_perf_buffer)
+    {
+        Log::fatal()
+            << "--flight-recorder can not be used in conjunction with --shared-perf-buffer";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Without a readout interval, we would never notice the flight recorder being triggered
+    if (config.flight_recorder && config.perf_read_interval.count() == 0)
+    {
+        config.perf_read_interval = config.read_interval;
+    }
+
     if (!arguments.given("disassemble"))
     {
         config.disassemble = false;
@@ -746,6 +943,25 @@ void parse_program_options(int argc, const char** argv)
 #endif
     }
 
+    // Giving a directory enables the cache, unless it is explicitly disabled
+    if (arguments.given("symbol-cache") ||
+        (!arguments.provided("symbol-cache") && arguments.provided("symbol-cache-dir")))
+    {
+        if (arguments.provided("symbol-cache-dir"))
+        {
+            config.symbol_cache_dir = arguments.get("symbol-cache-dir");
+        }
+        else if (const char* cache_home = std::getenv("XDG_CACHE_HOME");
+                 cache_home != nullptr && *cache_home != '\0')
+        {
+            config.symbol_cache_dir = std::string(cache_home) + "/lo2s";
+        }
+        else if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        {
+            config.symbol_cache_dir = std::string(home) + "/.cache/lo2s";
+        }
+    }
+
     if (arguments.provided("metric-count") && !arguments.provided("metric-leader"))
     {
         Log::fatal() << "--metric-count can only be used in conjunction with a --metric-leader";
@@ -799,6 +1015,12 @@ void parse_program_options(int argc, const char** argv)
         arguments.get_all("tracepoint"));
     perf::counter::CounterProvider::instance().initialize_group_counters(
         arguments.get("metric-leader"), perf_group_events);
+    config.metric_keyframe_interval = arguments.as<std::uint64_t>("metric-keyframe-interval");
+    config.metric_suppression_relative = arguments.as<double>("metric-suppression-epsilon");
+    config.metric_suppression_absolute = arguments.as<double>("metric-suppression-absolute");
+
+    perf::counter::CounterProvider::instance().initialize_derived_metrics(
+        arguments.get_all("derived-metric"), arguments.given("derived-metrics-only"));
     perf::counter::CounterProvider::instance().initialize_userspace_counters(perf_userspace_events);
 
     config.exclude_kernel = !static_cast<bool>(arguments.given("kernel"));
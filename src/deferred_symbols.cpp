@@ -0,0 +1,120 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/deferred_symbols.hpp>
+
+#include <lo2s/log.hpp>
+#include <lo2s/symbol_cache.hpp>
+
+#include <fmt/core.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace lo2s
+{
+
+std::string DeferredSymbols::function_placeholder(const std::string& binary, Address offset)
+{
+    return fmt::format("{}+0x{:x}", binary, offset.value());
+}
+
+std::string DeferredSymbols::file_placeholder(const std::string& binary, Address offset)
+{
+    // Has to differ from the function placeholder, so that both get their own string definition
+    return fmt::format("{}+0x{:x} <unresolved file>", binary, offset.value());
+}
+
+LineInfo DeferredSymbols::add(const std::string& binary, Address offset)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        binaries_[binary].emplace(offset);
+    }
+    return LineInfo::for_function(file_placeholder(binary, offset).c_str(),
+                                  function_placeholder(binary, offset).c_str(), 0, binary);
+}
+
+// The sidecar file consists of a "binary <build-id> <path>" line for every binary, followed by
+// the hexadecimal file offsets in that binary, one per line. A missing build-id is written as "-".
+void DeferredSymbols::write(const std::filesystem::path& trace_dir)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    auto path = trace_dir / SIDECAR_FILENAME;
+    std::ofstream out(path);
+    for (const auto& binary : binaries_)
+    {
+        auto build_id = read_build_id(binary.first);
+        out << "binary " << build_id.value_or("-") << " " << binary.first << "\n";
+        for (auto offset : binary.second)
+        {
+            out << fmt::format("{:x}\n", offset.value());
+        }
+    }
+
+    if (!out)
+    {
+        Log::error() << "could not write deferred symbols to " << path;
+        return;
+    }
+    Log::info() << "Symbols of " << binaries_.size() << " binaries were deferred, resolve them "
+                << "using: lo2s-resolve " << trace_dir.string();
+}
+
+std::vector<DeferredSymbols::Binary> DeferredSymbols::read(const std::filesystem::path& trace_dir)
+{
+    auto path = trace_dir / SIDECAR_FILENAME;
+    std::ifstream in(path);
+    if (!in)
+    {
+        throw std::runtime_error("could not open " + path.string());
+    }
+
+    std::vector<Binary> binaries;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.rfind("binary ", 0) == 0)
+        {
+            std::istringstream fields(line.substr(7));
+            Binary binary;
+            fields >> binary.build_id;
+            std::getline(fields >> std::ws, binary.path);
+            if (binary.build_id == "-")
+            {
+                binary.build_id.clear();
+            }
+            binaries.emplace_back(std::move(binary));
+        }
+        else if (!line.empty())
+        {
+            if (binaries.empty())
+            {
+                throw std::runtime_error("malformed deferred symbol file " + path.string());
+            }
+            binaries.back().offsets.emplace(std::stoull(line, nullptr, 16));
+        }
+    }
+    return binaries;
+}
+} // namespace lo2s
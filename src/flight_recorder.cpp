@@ -0,0 +1,114 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/config.hpp>
+#include <lo2s/error.hpp>
+#include <lo2s/flight_recorder.hpp>
+#include <lo2s/log.hpp>
+
+#include <filesystem>
+#include <system_error>
+
+#include <csignal>
+#include <cstring>
+
+namespace lo2s
+{
+
+std::atomic<std::uint64_t> FlightRecorder::generation_(0);
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "the flight recorder generation must be modifiable from a signal handler");
+
+FlightRecorder::FlightRecorder()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &FlightRecorder::signal_handler;
+    // Restart interrupted syscalls where possible, the remaining ones (e.g. poll) have to cope
+    // with EINTR anyway
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(SIGUSR1, &sa, nullptr) == -1)
+    {
+        Log::error() << "Failed to install the SIGUSR1 handler for the flight recorder";
+        throw_errno();
+    }
+
+    Log::debug() << "flight recorder armed, send SIGUSR1 to dump the perf buffers";
+}
+
+void FlightRecorder::signal_handler(int)
+{
+    generation_++;
+}
+
+void FlightRecorder::trigger()
+{
+    generation_++;
+}
+
+std::uint64_t FlightRecorder::generation()
+{
+    if (!config().flight_recorder_trigger_file.empty())
+    {
+        check_trigger_file();
+    }
+
+    return generation_.load();
+}
+
+void FlightRecorder::check_trigger_file()
+{
+    // Every monitor asks for the generation on each of its readouts, but one of them looking
+    // for the trigger file per readout interval is plenty
+    std::unique_lock<std::mutex> lock(trigger_file_mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_trigger_file_check_ < config().perf_read_interval)
+    {
+        return;
+    }
+    last_trigger_file_check_ = now;
+
+    std::error_code ec;
+    if (!std::filesystem::exists(config().flight_recorder_trigger_file, ec))
+    {
+        return;
+    }
+
+    Log::info() << "flight recorder triggered by " << config().flight_recorder_trigger_file;
+
+    // Remove the trigger file, so that it can be used to trigger the next dump
+    if (!std::filesystem::remove(config().flight_recorder_trigger_file, ec))
+    {
+        Log::warn() << "Could not remove flight recorder trigger file "
+                    << config().flight_recorder_trigger_file << ": " << ec.message();
+    }
+
+    trigger();
+}
+} // namespace lo2s
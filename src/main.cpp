@@ -19,11 +19,13 @@
  * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <lo2s/config.hpp>
+#include <lo2s/flight_recorder.hpp>
 #include <lo2s/log.hpp>
 #include <lo2s/monitor/cpu_set_monitor.hpp>
 #include <lo2s/monitor/process_monitor.hpp>
 #include <lo2s/monitor/process_monitor_main.hpp>
 #include <lo2s/summary.hpp>
+#include <lo2s/symbol_cache.hpp>
 #include <lo2s/util.hpp>
 
 #include <system_error>
@@ -42,6 +44,12 @@ int main(int argc, const char** argv)
     {
         lo2s::parse_program_options(argc, argv);
         lo2s::summary();
+        lo2s::SymbolCache::instance().set_directory(lo2s::config().symbol_cache_dir);
+
+        if (lo2s::config().flight_recorder)
+        {
+            lo2s::FlightRecorder::instance();
+        }
 
         switch (lo2s::config().monitor_type)
         {
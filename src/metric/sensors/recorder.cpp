@@ -71,7 +71,8 @@ Recorder::Recorder(trace::Trace& trace)
 : PollMonitor(trace, "Sensors recorder", config().read_interval),
   otf2_writer_(trace.create_metric_writer(name())),
   metric_instance_(trace.metric_instance(trace.metric_class(), otf2_writer_.location(),
-                                         trace.system_tree_root_node()))
+                                         trace.system_tree_root_node())),
+  suppressor_(otf2_writer_)
 {
     sensors_init(nullptr);
 
@@ -139,7 +140,7 @@ Recorder::Recorder(trace::Trace& trace)
     event_ = std::make_unique<otf2::event::metric>(otf2::chrono::genesis(), metric_instance_);
 }
 
-void Recorder::monitor([[maybe_unused]] int fd)
+void Recorder::on_timer()
 {
     // update timestamp
     event_->timestamp(time::now());
@@ -157,10 +158,11 @@ void Recorder::monitor([[maybe_unused]] int fd)
 
         auto i = index_items.index();
         event_->raw_values()[i] = value;
+        suppressor_.set(i, value);
     }
 
-    // write event to archive
-    otf2_writer_.write(*event_);
+    // write event to archive, unless no sensor changed
+    suppressor_.write(*event_);
 }
 
 Recorder::~Recorder()
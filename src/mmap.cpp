@@ -19,7 +19,9 @@
  * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <lo2s/config.hpp>
 #include <lo2s/line_info.hpp>
+#include <lo2s/line_scanner.hpp>
 #include <lo2s/mmap.hpp>
 #include <lo2s/util.hpp>
 
@@ -28,7 +30,6 @@
 #include <fmt/core.h>
 
 #include <mutex>
-#include <regex>
 #include <utility>
 
 namespace lo2s
@@ -52,31 +53,42 @@ MemoryMap::MemoryMap(Process process, bool read_initial)
     // Supposedly this one is faster than /proc/%d/maps for processes with many threads
     auto filename = fmt::format("/proc/{}/task/{}/maps", process.as_pid_t(), process.as_pid_t());
 
-    std::ifstream mapstream(filename);
-    if (mapstream.fail())
+    LineScanner mapstream(filename);
+    if (!mapstream.ok())
     {
         Log::error() << "could not open maps file " << filename;
         // Gracefully return an initially empty map that always fails.
         return;
     }
-    std::string line;
 
-    //                 start       -    end          prot           offset
-    //                 device  inode   dso
-    // NOTE: we only look at executable entries       here ↓
-    std::regex regex("([0-9a-f]+)\\-([0-9a-f]+)\\s+[r-][w-]x.?\\s+([0-9a-z]+)"
-                     "\\s+\\S+\\s+\\d+\\s+(.*)");
     Log::debug() << "opening " << filename;
-    while (getline(mapstream, line))
+    std::string_view line;
+    while (mapstream.next(line))
     {
         Log::trace() << "map entry: " << line;
-        std::smatch match;
-        if (std::regex_match(line, match, regex))
+
+        // start-end prot offset device inode dso
+        uint64_t start, end, offset;
+        if (!scan::hex(line, start) || !scan::consume(line, '-') || !scan::hex(line, end))
+        {
+            continue;
+        }
+        // NOTE: we only look at executable entries
+        auto prot = scan::field(line);
+        if (prot.size() < 3 || prot[2] != 'x')
+        {
+            continue;
+        }
+        scan::skip_spaces(line);
+        if (!scan::hex(line, offset))
         {
-            RawMemoryMapEntry entry(Address(match.str(1)), Address(match.str(2)),
-                                    Address(match.str(3)), match.str(4));
-            mmap(entry);
+            continue;
         }
+        scan::field(line); // device
+        scan::field(line); // inode
+        scan::skip_spaces(line);
+
+        mmap(RawMemoryMapEntry(start, end, offset, std::string(line)));
     }
 }
 
@@ -101,6 +113,10 @@ void MemoryMap::mmap(const RawMemoryMapEntry& entry)
     {
         lb = &NamedBinary::cache(entry.filename);
     }
+    else if (config().defer_symbols)
+    {
+        lb = &DeferredBinary::cache(entry.filename);
+    }
     else
     {
         try
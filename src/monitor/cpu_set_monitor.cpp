@@ -22,6 +22,8 @@
 #include <lo2s/monitor/cpu_set_monitor.hpp>
 
 #include <lo2s/error.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/mmap.hpp>
 #include <lo2s/topology.hpp>
 #include <lo2s/util.hpp>
 
@@ -29,9 +31,12 @@
 #include <lo2s/monitor/system_process_monitor.hpp>
 #include <lo2s/perf/counter/counter_provider.hpp>
 
-#include <filesystem>
-
-#include <regex>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <csignal>
 
@@ -39,33 +44,15 @@ namespace lo2s
 {
 namespace monitor
 {
+namespace
+{
+constexpr std::size_t COMMS_BATCH_SIZE = 1024;
+} // namespace
+
 CpuSetMonitor::CpuSetMonitor() : MainMonitor()
 {
     trace_.add_monitoring_thread(gettid(), "CpuSetMonitor", "CpuSetMonitor");
 
-    // Prefill Memory maps
-    std::regex proc_regex("/proc/([0-9]+)");
-    std::smatch pid_match;
-    pid_t pid;
-
-    const std::filesystem::path proc_path("/proc");
-    if (config().sampling)
-    {
-        for (const auto& p : std::filesystem::directory_iterator(proc_path))
-        {
-            std::string path = p.path().string();
-            if (std::regex_match(path, pid_match, proc_regex))
-            {
-                pid = std::stol(pid_match[1]);
-
-                process_infos_.emplace(std::piecewise_construct, std::forward_as_tuple(pid),
-                                       std::forward_as_tuple(Process(pid), false));
-            }
-        }
-    }
-
-    trace_.add_threads(get_comms_for_running_threads());
-
     try
     {
         for (const auto& cpu : Topology::instance().cpus())
@@ -94,6 +81,80 @@ CpuSetMonitor::CpuSetMonitor() : MainMonitor()
 
         throw;
     }
+
+    // Reading the memory maps and comms of every running process takes seconds on busy hosts, so
+    // it happens in the background while the CPU monitors are already recording
+    prefill_thread_ = std::thread([this]() { prefill(); });
+}
+
+CpuSetMonitor::~CpuSetMonitor()
+{
+    finish_prefill();
+}
+
+void CpuSetMonitor::prefill()
+{
+    // SIGINT is for the main thread, the workers inherit this mask
+    sigset_t ss;
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &ss, NULL);
+
+    auto start = std::chrono::steady_clock::now();
+    const auto processes = get_running_processes();
+    std::atomic<std::size_t> next_process = 0;
+
+    auto worker = [this, &processes, &next_process]() {
+        trace_.add_monitoring_thread(gettid(), "CpuSetMonitor prefill", "CpuSetMonitor");
+
+        std::unordered_map<Thread, std::string> comms;
+        for (std::size_t i = next_process++; i < processes.size(); i = next_process++)
+        {
+            Process process = processes[i];
+            if (config().sampling)
+            {
+                // Only the insertion is serialized, parsing the maps and opening the binaries
+                // happens in parallel
+                MemoryMap maps(process, true);
+                std::lock_guard<std::mutex> guard(process_infos_mutex_);
+                process_infos_.try_emplace(process, process, std::move(maps));
+            }
+            comms.merge(get_comms_for_process(process));
+
+            // Hand the comms over in batches, so that they are known to the trace early
+            if (comms.size() >= COMMS_BATCH_SIZE)
+            {
+                trace_.add_threads(comms);
+                comms.clear();
+            }
+        }
+        trace_.add_threads(comms);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < std::thread::hardware_concurrency(); i++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+
+    Log::debug() << "Read the memory maps and comms of " << processes.size() << " processes in "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count()
+                 << "ms";
+}
+
+void CpuSetMonitor::finish_prefill()
+{
+    if (prefill_thread_.joinable())
+    {
+        prefill_thread_.join();
+    }
 }
 
 void CpuSetMonitor::run()
@@ -139,6 +200,10 @@ void CpuSetMonitor::run()
         }
     }
 
+    // The sample writers insert their cached mmap events into the prefilled memory maps when
+    // they are stopped
+    finish_prefill();
+
     trace_.add_threads(get_comms_for_running_threads());
 
     for (auto& monitor_elem : monitors_)
@@ -48,6 +48,11 @@ MainMonitor::MainMonitor() : trace_(), metrics_(trace_)
 
     // TODO we can still have events earlier due to different timers.
 
+    if (config().sampling && config().cctx_merge_interval.count() > 0)
+    {
+        trace_.start_cctx_merger(process_infos_, process_infos_mutex_);
+    }
+
     // try to initialize raw counter metrics
     if (!config().tracepoint_events.empty())
     {
@@ -67,7 +72,14 @@ MainMonitor::MainMonitor() : trace_(), metrics_(trace_)
 
     if (config().use_block_io)
     {
-        bio_monitor_ = std::make_unique<IoMonitor<perf::bio::Writer>>(trace_);
+        if (config().block_io_histogram)
+        {
+            bio_monitor_ = std::make_unique<IoMonitor<perf::bio::HistogramWriter>>(trace_);
+        }
+        else
+        {
+            bio_monitor_ = std::make_unique<IoMonitor<perf::bio::Writer>>(trace_);
+        }
         bio_monitor_->start();
     }
 
@@ -130,6 +142,7 @@ MainMonitor::MainMonitor() : trace_(), metrics_(trace_)
 
 void MainMonitor::insert_cached_mmap_events(const RawMemoryMapCache& cached_events)
 {
+    std::lock_guard<std::mutex> guard(process_infos_mutex_);
     for (auto& event : cached_events)
     {
         auto process_info =
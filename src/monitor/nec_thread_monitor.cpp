@@ -46,7 +46,7 @@ NecThreadMonitor::NecThreadMonitor(Thread thread, trace::Trace& trace, NecDevice
     otf2_writer_.write_calling_context_enter(lo2s::time::now(), cctx_manager_.current(), 2);
 }
 
-void NecThreadMonitor::monitor([[maybe_unused]] int fd)
+void NecThreadMonitor::on_timer()
 {
     static int reg[] = {
         VE_USR_PMC00, VE_USR_PMC01, VE_USR_PMC02, VE_USR_PMC03, VE_USR_PMC04, VE_USR_PMC05,
@@ -25,6 +25,13 @@
 #include <lo2s/util.hpp>
 
 #include <cmath>
+#include <cstring>
+
+extern "C"
+{
+#include <sys/epoll.h>
+#include <unistd.h>
+}
 
 namespace lo2s
 {
@@ -34,40 +41,71 @@ PollMonitor::PollMonitor(trace::Trace& trace, const std::string& name,
                          std::chrono::nanoseconds read_interval)
 : ThreadedMonitor(trace, name)
 {
-    pfds_.resize(2);
-    stop_pfd().fd = stop_pipe_.read_fd();
-    stop_pfd().events = POLLIN;
-    stop_pfd().revents = 0;
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+    {
+        Log::error() << "Creating the epoll instance failed";
+        throw_errno();
+    }
 
-    // Create and initialize timer_fd
-    struct itimerspec tspec;
-    memset(&tspec, 0, sizeof(struct itimerspec));
+    add_fd(stop_pipe_.read_fd(), [this]() {
+        Log::debug() << "Requested stop of PollMonitor";
+        stop_requested_ = true;
+    });
 
-    // Set initial expiration to lowest possible value, this together with TFD_TIMER_ABSTIME should
-    // synchronize our timers
+    // If the interval is 0, interval based readouts are disabled
     if (read_interval.count() != 0)
     {
+        add_timer(read_interval, [this]() { on_timer(); });
+    }
+}
 
-        timer_pfd().fd = timerfd_from_ns(read_interval);
-        timer_pfd().events = POLLIN;
-        timer_pfd().revents = 0;
+void PollMonitor::add_fd(int fd, std::function<void()> handler, bool edge_triggered)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (edge_triggered)
+    {
+        ev.events |= EPOLLET;
     }
-    else
+    // The index of the handler is the payload, so we do not have to look it up by the fd
+    ev.data.u64 = handlers_.size();
+
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1)
     {
-        // fd = -1 is just going to be ignored
-        timer_pfd().fd = -1;
-        timer_pfd().events = 0;
-        timer_pfd().revents = 0;
+        Log::error() << "Adding fd " << fd << " to the epoll instance failed";
+        throw_errno();
     }
+    handlers_.emplace_back(std::move(handler));
+}
+
+void PollMonitor::add_timer(std::chrono::nanoseconds interval, std::function<void()> handler)
+{
+    int timer_fd = timerfd_from_ns(interval);
+    timer_fds_.push_back(timer_fd);
+
+    add_timer_fd(timer_fd, std::move(handler));
 }
 
-void PollMonitor::add_fd(int fd)
+void PollMonitor::add_timer_fd(int timer_fd, std::function<void()> handler)
 {
-    struct pollfd pfd;
-    pfd.fd = fd;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-    pfds_.push_back(pfd);
+    add_fd(timer_fd, [timer_fd, handler = std::move(handler)]() {
+        // Flush timer
+        [[maybe_unused]] uint64_t expirations;
+        if (read(timer_fd, &expirations, sizeof(expirations)) == -1)
+        {
+            // Another handler of this wakeup might have taken long enough for the read to race
+            // with the next expiration, nothing to do then
+            if (errno == EAGAIN)
+            {
+                return;
+            }
+            Log::error() << "Flushing timer fd failed";
+            throw_errno();
+        }
+        handler();
+    });
 }
 
 void PollMonitor::stop()
@@ -82,77 +120,77 @@ void PollMonitor::stop()
     thread_.join();
 }
 
-void PollMonitor::monitor()
+bool PollMonitor::dispatch(int timeout)
 {
-    for (const auto& pfd : pfds_)
+    events_.resize(handlers_.size());
+    int ret;
+    do
+    {
+        ret = epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout);
+        // epoll_wait is never restarted after a signal handler ran, e.g. the one of the flight
+        // recorder
+    } while (ret == -1 && errno == EINTR);
+    num_wakeups_++;
+
+    if (ret == 0 && timeout == -1)
+    {
+        throw std::runtime_error("Received epoll timeout despite requesting no timeout.");
+    }
+    else if (ret < 0)
+    {
+        Log::error() << "epoll_wait failed";
+        throw_errno();
+    }
+    Log::trace() << "PollMonitor epoll_wait returned " << ret;
+
+    for (int i = 0; i < ret; i++)
     {
-        if (pfd.revents & POLLIN)
+        if (events_[i].events != EPOLLIN)
         {
-            monitor(pfd.fd);
+            Log::warn() << "Poll on raw event fds got unexpected event flags: "
+                        << events_[i].events << ". Stopping raw event polling.";
+            return false;
         }
     }
+
+    for (int i = 0; i < ret; i++)
+    {
+        handlers_[events_[i].data.u64]();
+    }
+    return true;
 }
 
 void PollMonitor::run()
 {
-    bool stop_requested = false;
     do
     {
-        auto ret = ::poll(pfds_.data(), pfds_.size(), -1);
-        num_wakeups_++;
-
-        if (ret == 0)
+        if (!dispatch(-1))
         {
-            throw std::runtime_error("Received poll timeout despite requesting no timeout.");
+            return;
         }
-        else if (ret < 0)
-        {
-            Log::error() << "poll failed";
-            throw_errno();
-        }
-        Log::trace() << "PollMonitor poll returned " << ret;
+    } while (!stop_requested_);
 
-        bool panic = false;
-        for (const auto& pfd : pfds_)
-        {
-            if (pfd.revents != 0 && pfd.revents != POLLIN)
-            {
-                Log::warn() << "Poll on raw event fds got unexpected event flags: " << pfd.revents
-                            << ". Stopping raw event polling.";
-                panic = true;
-            }
-        }
-        if (panic)
-        {
-            break;
-        }
+    on_stop();
+}
 
-        monitor();
+bool PollMonitor::handle_ready()
+{
+    return dispatch(0);
+}
 
-        // Flush timer
-        if (timer_pfd().revents & POLLIN)
-        {
-            [[maybe_unused]] uint64_t expirations;
-            if (read(timer_pfd().fd, &expirations, sizeof(expirations)) == -1)
-            {
-                Log::error() << "Flushing timer fd failed";
-                throw_errno();
-            }
-        }
-        if (stop_pfd().revents & POLLIN)
-        {
-            Log::debug() << "Requested stop of PollMonitor";
-            stop_requested = true;
-        }
-    } while (!stop_requested);
+void PollMonitor::finish()
+{
+    on_stop();
+    finalize_thread();
 }
 
 PollMonitor::~PollMonitor()
 {
-    if (timer_pfd().fd != -1)
+    for (auto timer_fd : timer_fds_)
     {
-        close(timer_pfd().fd);
+        close(timer_fd);
     }
+    close(epoll_fd_);
 }
 
 } // namespace monitor
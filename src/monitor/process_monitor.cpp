@@ -19,10 +19,12 @@
  * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <lo2s/config.hpp>
 #include <lo2s/monitor/process_monitor.hpp>
 #include <lo2s/monitor/scope_monitor.hpp>
 #include <lo2s/perf/counter/counter_provider.hpp>
 #include <lo2s/process_info.hpp>
+#include <lo2s/topology.hpp>
 
 namespace lo2s
 {
@@ -32,12 +34,32 @@ namespace monitor
 ProcessMonitor::ProcessMonitor() : MainMonitor()
 {
     trace_.add_monitoring_thread(gettid(), "ProcessMonitor", "ProcessMonitor");
+
+    if (config().reader_pool_size > 0)
+    {
+        reader_pool_.emplace(trace_, config().reader_pool_size);
+    }
 }
 
 void ProcessMonitor::insert_process(Process parent, Process process, std::string proc_name,
                                     bool spawn)
 {
     trace_.add_process(parent, process, proc_name);
+
+    if (config().per_cpu_inherit && parent == trace::Trace::NO_PARENT_PROCESS && cpus_.empty())
+    {
+        // The events are inherited by every thread the process creates from now on, so no
+        // perf_event_open() is needed for them. This also catches the first moments of short-lived
+        // threads, which are lost while setting up a monitor per thread.
+        for (const auto& cpu : Topology::instance().cpus())
+        {
+            auto inserted = cpus_.emplace(
+                std::piecewise_construct, std::forward_as_tuple(cpu),
+                std::forward_as_tuple(ExecutionScope(cpu), *this, spawn, false, process));
+            inserted.first->second.start();
+        }
+    }
+
     insert_thread(process, process.as_thread(), proc_name, spawn, true);
 }
 
@@ -48,21 +70,30 @@ void ProcessMonitor::insert_thread(Process process, Thread thread, std::string n
 
     if (config().sampling)
     {
+        std::lock_guard<std::mutex> guard(process_infos_mutex_);
         process_infos_.try_emplace(process, process, spawn);
     }
 
-    if (config().sampling ||
+    if ((config().sampling && !config().per_cpu_inherit) ||
         perf::counter::CounterProvider::instance().has_group_counters(ExecutionScope(thread)) ||
         perf::counter::CounterProvider::instance().has_userspace_counters(ExecutionScope(thread)))
     {
         try
         {
-            auto inserted = threads_.emplace(
-                std::piecewise_construct, std::forward_as_tuple(thread),
-                std::forward_as_tuple(ExecutionScope(thread), *this, spawn, is_process));
-            assert(inserted.second);
-            // actually start thread
-            inserted.first->second.start();
+            if (reader_pool_)
+            {
+                reader_pool_->insert(thread, std::make_unique<ScopeMonitor>(
+                                                 ExecutionScope(thread), *this, spawn, is_process));
+            }
+            else
+            {
+                auto inserted = threads_.emplace(
+                    std::piecewise_construct, std::forward_as_tuple(thread),
+                    std::forward_as_tuple(ExecutionScope(thread), *this, spawn, is_process));
+                assert(inserted.second);
+                // actually start thread
+                inserted.first->second.start();
+            }
         }
         catch (const std::exception& e)
         {
@@ -80,6 +111,12 @@ void ProcessMonitor::update_process_name(Process process, const std::string& nam
 
 void ProcessMonitor::exit_thread(Thread thread)
 {
+    if (reader_pool_)
+    {
+        reader_pool_->remove(thread);
+        return;
+    }
+
     if (threads_.count(thread) != 0)
     {
         threads_.at(thread).stop();
@@ -89,10 +126,18 @@ void ProcessMonitor::exit_thread(Thread thread)
 
 ProcessMonitor::~ProcessMonitor()
 {
+    // Do the final readouts while the trace is still around
+    reader_pool_.reset();
+
     for (auto& thread : threads_)
     {
         thread.second.stop();
     }
+
+    for (auto& cpu : cpus_)
+    {
+        cpu.second.stop();
+    }
 }
 } // namespace monitor
 } // namespace lo2s
@@ -25,6 +25,7 @@
 #include <lo2s/monitor/abstract_process_monitor.hpp>
 
 #include <lo2s/process_controller.hpp>
+#include <lo2s/task_controller.hpp>
 #include <lo2s/util.hpp>
 
 #include <lo2s/build_config.hpp>
@@ -36,6 +37,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -50,6 +52,7 @@ extern "C"
 
 #include <sys/prctl.h>
 #include <sys/ptrace.h>
+#include <sys/wait.h>
 }
 
 namespace lo2s
@@ -150,7 +153,10 @@ std::vector<char*> to_vector_of_c_str(const std::vector<std::string>& vec)
     prctl(PR_SET_PDEATHSIG, SIGHUP);
 
     /* we need ptrace to get fork/clone/... */
-    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    if (config().use_ptrace)
+    {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    }
 
     std::vector<std::string> env;
 #ifdef HAVE_CUDA
@@ -240,6 +246,27 @@ void process_monitor_main(AbstractProcessMonitor& monitor)
             proc_name = get_process_comm(process);
         }
 
+        if (!config().use_ptrace)
+        {
+            assert(spawn);
+
+            // Wait for the child to stop itself before exec, see run_command()
+            int status;
+            if (waitpid(process.as_pid_t(), &status, WUNTRACED) == -1)
+            {
+                throw_errno();
+            }
+            if (!WIFSTOPPED(status))
+            {
+                Log::error() << "Child did not stop before executing the command";
+                throw std::runtime_error("Child did not stop before executing the command");
+            }
+
+            TaskController controller(process, proc_name, monitor);
+            controller.run();
+            return;
+        }
+
         ProcessController controller(process, proc_name, spawn, monitor);
         controller.run();
     }
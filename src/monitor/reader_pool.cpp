@@ -0,0 +1,215 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/monitor/reader_pool.hpp>
+
+#include <lo2s/error.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/summary.hpp>
+#include <lo2s/trace/trace.hpp>
+#include <lo2s/util.hpp>
+
+#include <fmt/core.h>
+
+extern "C"
+{
+#include <sys/epoll.h>
+#include <unistd.h>
+}
+
+namespace lo2s
+{
+namespace monitor
+{
+// id of the stop pipe in the shared epoll instance, monitors start at 1
+constexpr std::uint64_t STOP_ID = 0;
+
+ReaderPool::ReaderPool(trace::Trace& trace, std::size_t size) : trace_(trace)
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+    {
+        Log::error() << "Failed to create epoll instance for the reader pool";
+        throw_errno();
+    }
+
+    // Not one-shot, so that every worker gets to see it
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = STOP_ID;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_pipe_.read_fd(), &ev) == -1)
+    {
+        close(epoll_fd_);
+        throw_errno();
+    }
+
+    Log::debug() << "Starting reader pool with " << size << " threads";
+    for (std::size_t i = 0; i < size; i++)
+    {
+        workers_.emplace_back([this, i]() { worker_main(i); });
+    }
+}
+
+void ReaderPool::insert(Thread thread, std::unique_ptr<PollMonitor> monitor)
+{
+    auto entry = std::make_shared<Entry>();
+    entry->monitor = std::move(monitor);
+    int fd = entry->monitor->epoll_fd();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = next_id_++;
+    entries_.emplace(id, entry);
+    ids_.emplace(thread, id);
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        entries_.erase(id);
+        ids_.erase(thread);
+        throw_errno();
+    }
+}
+
+void ReaderPool::remove(Thread thread)
+{
+    std::uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = ids_.find(thread);
+        if (it == ids_.end())
+        {
+            return;
+        }
+        id = it->second;
+        ids_.erase(it);
+    }
+    remove_entry(id);
+}
+
+void ReaderPool::remove_entry(std::uint64_t id)
+{
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(id);
+        if (it == entries_.end())
+        {
+            return;
+        }
+        entry = it->second;
+        entries_.erase(it);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, entry->monitor->epoll_fd(), nullptr);
+    }
+
+    // Waits for a worker that is currently reading this monitor. Its attempt to re-arm the
+    // monitor fails, as it is no longer registered.
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    entry->monitor->finish();
+    entry->monitor.reset();
+}
+
+void ReaderPool::worker_main(std::size_t index)
+{
+    trace_.add_monitoring_thread(gettid(), fmt::format("ReaderPool {}", index),
+                                 "lo2s::ReaderPool");
+
+    std::size_t num_wakeups = 0;
+    while (true)
+    {
+        struct epoll_event ev;
+        auto ret = epoll_wait(epoll_fd_, &ev, 1, -1);
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            Log::error() << "epoll_wait in reader pool failed";
+            throw_errno();
+        }
+        num_wakeups++;
+
+        if (ev.data.u64 == STOP_ID)
+        {
+            break;
+        }
+
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(ev.data.u64);
+            if (it == entries_.end())
+            {
+                continue;
+            }
+            entry = it->second;
+        }
+
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->monitor || !entry->monitor->handle_ready())
+        {
+            // leave it disarmed, remove() will do the final readout
+            continue;
+        }
+
+        struct epoll_event rearm = {};
+        rearm.events = EPOLLIN | EPOLLONESHOT;
+        rearm.data.u64 = ev.data.u64;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, entry->monitor->epoll_fd(), &rearm) == -1 &&
+            errno != ENOENT)
+        {
+            Log::error() << "Failed to re-arm monitor in reader pool";
+            throw_errno();
+        }
+    }
+
+    summary().record_perf_wakeups(num_wakeups);
+}
+
+ReaderPool::~ReaderPool()
+{
+    std::vector<std::uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : entries_)
+        {
+            ids.push_back(entry.first);
+        }
+        ids_.clear();
+    }
+
+    for (auto id : ids)
+    {
+        remove_entry(id);
+    }
+
+    stop_pipe_.write();
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+
+    close(epoll_fd_);
+}
+} // namespace monitor
+} // namespace lo2s
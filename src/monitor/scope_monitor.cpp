@@ -22,6 +22,7 @@
 #include <lo2s/monitor/scope_monitor.hpp>
 
 #include <lo2s/config.hpp>
+#include <lo2s/flight_recorder.hpp>
 #include <lo2s/log.hpp>
 #include <lo2s/monitor/process_monitor.hpp>
 #include <lo2s/perf/sample/writer.hpp>
@@ -40,41 +41,77 @@ namespace monitor
 {
 
 ScopeMonitor::ScopeMonitor(ExecutionScope scope, MainMonitor& parent, bool enable_on_exec,
-                           bool is_process)
+                           bool is_process, Process inherit_process)
 : PollMonitor(parent.trace(), scope.name(), config().perf_read_interval), scope_(scope)
 {
-    if (config().sampling || scope.is_cpu())
+    if (inherit_process != Process::invalid())
     {
-        sample_writer_ =
-            std::make_unique<perf::sample::Writer>(scope, parent, parent.trace(), enable_on_exec);
-        add_fd(sample_writer_->fd());
+        sample_writer_ = std::make_unique<perf::sample::Writer>(
+            scope, parent, parent.trace(), enable_on_exec, nullptr, inherit_process);
+        if (!config().flight_recorder)
+        {
+            add_perf_reader(*sample_writer_);
+        }
+        return;
+    }
+
+    if (scope.is_cpu() && config().shared_perf_buffer)
+    {
+        shared_buffer_reader_ = std::make_unique<perf::SharedBufferReader>(scope.as_cpu());
+        add_perf_reader(*shared_buffer_reader_);
+    }
+
+    // In flight recorder mode, the buffers are only read when triggered, so do not get woken up
+    // by them. If the buffer is shared, only the shared buffer wakes us up.
+    bool poll_writers = !config().flight_recorder && !shared_buffer_reader_;
+
+    // With --per-cpu-inherit, the cpu monitors take care of sampling
+    if ((config().sampling && !config().per_cpu_inherit) || scope.is_cpu())
+    {
+        sample_writer_ = std::make_unique<perf::sample::Writer>(
+            scope, parent, parent.trace(), enable_on_exec, shared_buffer_reader_.get());
+        if (poll_writers)
+        {
+            add_perf_reader(*sample_writer_);
+        }
     }
 
     if (scope.is_cpu() && config().use_syscalls)
     {
-        syscall_writer_ = std::make_unique<perf::syscall::Writer>(scope.as_cpu(), parent.trace());
-        add_fd(syscall_writer_->fd());
+        syscall_writer_ = std::make_unique<perf::syscall::Writer>(scope.as_cpu(), parent.trace(),
+                                                                  shared_buffer_reader_.get());
+        if (!shared_buffer_reader_)
+        {
+            add_perf_reader(*syscall_writer_);
+        }
     }
 
     if (perf::counter::CounterProvider::instance().has_group_counters(scope))
     {
-        group_counter_writer_ =
-            std::make_unique<perf::counter::group::Writer>(scope, parent.trace(), enable_on_exec);
-        add_fd(group_counter_writer_->fd());
+        group_counter_writer_ = std::make_unique<perf::counter::group::Writer>(
+            scope, parent.trace(), enable_on_exec, shared_buffer_reader_.get());
+        if (poll_writers)
+        {
+            add_perf_reader(*group_counter_writer_);
+        }
     }
 
     if (perf::counter::CounterProvider::instance().has_userspace_counters(scope))
     {
         userspace_counter_writer_ =
             std::make_unique<perf::counter::userspace::Writer>(scope, parent.trace());
-        add_fd(userspace_counter_writer_->fd());
+        // read() flushes the timer itself
+        add_fd(userspace_counter_writer_->fd(), [this]() {
+            pin_to_scope();
+            userspace_counter_writer_->read();
+        });
     }
 
     if (config().use_nvidia && is_process)
     {
         cupti_reader_ =
             std::make_unique<cupti::Reader>(parent.trace(), scope.as_thread().as_process());
-        add_fd(cupti_reader_->fd());
+        add_timer_fd(cupti_reader_->fd(), [this]() { cupti_reader_->read(); });
     }
 
     // note: start() can now be called
@@ -82,7 +119,10 @@ ScopeMonitor::ScopeMonitor(ExecutionScope scope, MainMonitor& parent, bool enabl
 
 void ScopeMonitor::initialize_thread()
 {
-    try_pin_to_scope(scope_);
+    if (!config().reader_pool_size)
+    {
+        try_pin_to_scope(scope_);
+    }
 }
 
 void ScopeMonitor::finalize_thread()
@@ -93,39 +133,89 @@ void ScopeMonitor::finalize_thread()
     }
 }
 
-void ScopeMonitor::monitor(int fd)
+void ScopeMonitor::flight_recorder_dump(bool stopping)
 {
-    if (!scope_.is_cpu())
+    // The end of the measurement always dumps whatever is left in the buffers
+    auto generation = FlightRecorder::instance().generation();
+    if (!stopping && generation == flight_recorder_generation_)
     {
-        try_pin_to_scope(scope_);
+        return;
     }
+    flight_recorder_generation_ = generation;
 
-    if (cupti_reader_ && (fd == cupti_reader_->fd() || fd == stop_pfd().fd))
+    if (sample_writer_)
     {
-        cupti_reader_->read();
+        sample_writer_->read_backward();
     }
 
-    if (syscall_writer_ &&
-        (fd == timer_pfd().fd || fd == stop_pfd().fd || syscall_writer_->fd() == fd))
+    if (group_counter_writer_)
     {
-        syscall_writer_->read();
+        group_counter_writer_->read_backward();
     }
-    if (sample_writer_ &&
-        (fd == timer_pfd().fd || fd == stop_pfd().fd || sample_writer_->fd() == fd))
+}
+
+void ScopeMonitor::pin_to_scope()
+{
+    // Pinning a pooled reader would move it around with every monitored thread it reads
+    if (!scope_.is_cpu() && !config().reader_pool_size)
     {
-        sample_writer_->read();
+        try_pin_to_scope(scope_);
     }
+}
+
+void ScopeMonitor::read_all(bool stopping)
+{
+    pin_to_scope();
 
-    if (group_counter_writer_ &&
-        (fd == timer_pfd().fd || fd == stop_pfd().fd || group_counter_writer_->fd() == fd))
+    if (shared_buffer_reader_)
+    {
+        // Dispatches to the sample, syscall and group counter writers
+        shared_buffer_reader_->read();
+    }
+    else
     {
-        group_counter_writer_->read();
+        if (syscall_writer_)
+        {
+            syscall_writer_->read();
+        }
+
+        if (config().flight_recorder)
+        {
+            flight_recorder_dump(stopping);
+        }
+        else
+        {
+            if (sample_writer_)
+            {
+                sample_writer_->read();
+            }
+
+            if (group_counter_writer_)
+            {
+                group_counter_writer_->read();
+            }
+        }
     }
-    if (userspace_counter_writer_ &&
-        (fd == timer_pfd().fd || fd == stop_pfd().fd || userspace_counter_writer_->fd() == fd))
+
+    if (userspace_counter_writer_)
     {
         userspace_counter_writer_->read();
     }
 }
+
+void ScopeMonitor::on_timer()
+{
+    read_all(false);
+}
+
+void ScopeMonitor::on_stop()
+{
+    if (cupti_reader_)
+    {
+        cupti_reader_->read();
+    }
+
+    read_all(true);
+}
 } // namespace monitor
 } // namespace lo2s
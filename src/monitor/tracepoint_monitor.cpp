@@ -46,7 +46,7 @@ TracepointMonitor::TracepointMonitor(trace::Trace& trace, Cpu cpu)
         std::unique_ptr<perf::tracepoint::Writer> writer =
             std::make_unique<perf::tracepoint::Writer>(cpu, event.name(), trace, mc);
 
-        add_fd(writer->fd());
+        add_fd(writer->fd(), [w = writer.get()]() { w->read(); }, true);
         perf_writers_.emplace(std::piecewise_construct, std::forward_as_tuple(writer->fd()),
                               std::forward_as_tuple(std::move(writer)));
     }
@@ -57,21 +57,12 @@ void TracepointMonitor::initialize_thread()
     try_pin_to_scope(cpu_.as_scope());
 }
 
-void TracepointMonitor::monitor(int fd)
+void TracepointMonitor::on_stop()
 {
-    if (fd == timer_pfd().fd)
+    for (auto& perf_writer : perf_writers_)
     {
-        return;
+        perf_writer.second->read();
     }
-    else if (fd == stop_pfd().fd)
-    {
-        for (auto& perf_writer : perf_writers_)
-        {
-            perf_writer.second->read();
-        }
-        return;
-    }
-    perf_writers_.at(fd)->read();
 }
 
 void TracepointMonitor::finalize_thread()
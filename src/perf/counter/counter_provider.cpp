@@ -25,7 +25,10 @@
 #include <lo2s/perf/event_provider.hpp>
 #include <lo2s/platform.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <system_error>
 
 namespace lo2s
 {
@@ -33,6 +36,43 @@ namespace perf
 {
 namespace counter
 {
+namespace
+{
+// Trial opens leader and members as one group. Returns false if the kernel rejects the last
+// member, which it does if the group no longer fits onto the PMU.
+bool group_fits(Event leader, std::vector<Event> members)
+{
+    // Probe on ourselves if possible, otherwise on a CPU the new member supports
+    ExecutionScope scope = Thread(0).as_scope();
+    if (leader.availability() == Availability::SYSTEM_MODE ||
+        std::any_of(members.begin(), members.end(), [](const auto& ev) {
+            return ev.availability() == Availability::SYSTEM_MODE;
+        }))
+    {
+        const auto& cpus = members.back().supported_cpus();
+        scope = cpus.empty() ? Cpu(0).as_scope() : cpus.begin()->as_scope();
+    }
+
+    std::vector<EventGuard> guards;
+    guards.reserve(members.size() + 1);
+    try
+    {
+        guards.emplace_back(leader.open_as_group_leader(scope));
+        for (auto& member : members)
+        {
+            member.mut_attr().exclude_kernel = leader.attr().exclude_kernel;
+            guards.emplace_back(guards.front().open_child(member, scope));
+        }
+    }
+    catch (const std::system_error& e)
+    {
+        // Any other error will also occur, and be reported, when the group is opened for real
+        return e.code().value() != EINVAL || guards.size() != members.size();
+    }
+    return true;
+}
+} // namespace
+
 void CounterProvider::initialize_tracepoints(const std::vector<std::string>& tracepoints)
 {
     assert(tracepoint_events_.empty());
@@ -139,6 +179,83 @@ void CounterProvider::initialize_group_counters(const std::string& leader,
                         << "' does not name a known event, ignoring! (reason: " << e.what() << ")";
         }
     }
+
+    partition_group_counters();
+}
+
+// Only a limited number of hardware counters can be scheduled at once. Instead of failing to open
+// a group with more counters, split them into several groups, each with its own copy of the
+// leader, which are scheduled independently by the kernel. The counters are packed first-fit in
+// the order they were given.
+void CounterProvider::partition_group_counters()
+{
+    std::vector<std::vector<Event>> groups;
+    for (const auto& ev : group_events_)
+    {
+        auto group = std::find_if(groups.begin(), groups.end(), [this, &ev](const auto& other) {
+            auto members = other;
+            members.emplace_back(ev);
+            return group_fits(group_leader_.value(), members);
+        });
+
+        if (group == groups.end())
+        {
+            group = groups.emplace(groups.end());
+        }
+        group->emplace_back(ev);
+    }
+
+    if (groups.size() > 1)
+    {
+        Log::info() << "The " << group_events_.size()
+                    << " metric events do not fit onto the PMU at once, opening them as "
+                    << groups.size() << " groups";
+    }
+
+    group_events_.clear();
+    group_event_groups_.clear();
+    for (std::size_t group = 0; group < groups.size(); group++)
+    {
+        for (auto& ev : groups[group])
+        {
+            group_events_.emplace_back(std::move(ev));
+            group_event_groups_.emplace_back(group);
+        }
+    }
+}
+
+void CounterProvider::initialize_derived_metrics(const std::vector<std::string>& definitions,
+                                                 bool only)
+{
+    assert(derived_metrics_.empty());
+
+    for (const auto& definition : definitions)
+    {
+        try
+        {
+            DerivedMetric metric(definition);
+
+            for (const auto& operand : metric.operands())
+            {
+                if (operand != DerivedMetric::TIME && operand != group_leader_.value().name() &&
+                    std::none_of(group_events_.begin(), group_events_.end(),
+                                 [&operand](const auto& ev) { return ev.name() == operand; }))
+                {
+                    throw DerivedMetric::InvalidExpression(definition,
+                                                           "'" + operand +
+                                                               "' is not a metric event");
+                }
+            }
+
+            derived_metrics_.emplace_back(std::move(metric));
+        }
+        catch (const DerivedMetric::InvalidExpression& e)
+        {
+            Log::warn() << e.what() << ", ignoring!";
+        }
+    }
+
+    derived_metrics_only_ = only && !derived_metrics_.empty();
 }
 
 CounterCollection CounterProvider::collection_for(MeasurementScope scope)
@@ -153,11 +270,17 @@ CounterCollection CounterProvider::collection_for(MeasurementScope scope)
         if (group_leader_.value().is_available_in(scope.scope))
         {
             res.leader() = group_leader_.value();
-            for (auto& ev : group_events_)
+            std::optional<std::size_t> group;
+            for (std::size_t i = 0; i < group_events_.size(); i++)
             {
-                if (ev.is_available_in(scope.scope))
+                if (group_events_[i].is_available_in(scope.scope))
                 {
-                    res.counters.emplace_back(std::move(ev));
+                    if (group != group_event_groups_[i])
+                    {
+                        group = group_event_groups_[i];
+                        res.group_starts.emplace_back(res.counters.size());
+                    }
+                    res.counters.emplace_back(group_events_[i]);
                 }
             }
         }
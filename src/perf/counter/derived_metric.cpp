@@ -0,0 +1,246 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/perf/counter/derived_metric.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+namespace lo2s
+{
+namespace perf
+{
+namespace counter
+{
+namespace
+{
+void skip_space(const std::string& definition, std::size_t& pos)
+{
+    while (pos < definition.size() && std::isspace(static_cast<unsigned char>(definition[pos])))
+    {
+        pos++;
+    }
+}
+
+bool is_name_char(char c, bool first)
+{
+    if (std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+    {
+        return true;
+    }
+    return !first && (std::isdigit(static_cast<unsigned char>(c)) || c == '.' || c == ':' ||
+                      c == '-');
+}
+} // namespace
+
+DerivedMetric::DerivedMetric(const std::string& definition)
+{
+    auto equals = definition.find('=');
+    std::size_t pos = 0;
+    skip_space(definition, pos);
+    while (pos < equals && is_name_char(definition[pos], name_.empty()))
+    {
+        name_ += definition[pos++];
+    }
+    skip_space(definition, pos);
+
+    if (equals == std::string::npos || name_.empty() || pos != equals)
+    {
+        throw InvalidExpression(definition, "expected NAME=EXPRESSION");
+    }
+
+    pos = equals + 1;
+    parse_sum(definition, pos);
+    skip_space(definition, pos);
+
+    if (pos != definition.size())
+    {
+        throw InvalidExpression(definition, "unexpected '" + definition.substr(pos) + "'");
+    }
+
+    stack_.reserve(program_.size());
+}
+
+void DerivedMetric::parse_sum(const std::string& definition, std::size_t& pos)
+{
+    parse_product(definition, pos);
+
+    for (skip_space(definition, pos); pos < definition.size(); skip_space(definition, pos))
+    {
+        Instruction::Type type;
+        if (definition[pos] == '+')
+        {
+            type = Instruction::Type::ADD;
+        }
+        else if (definition[pos] == '-')
+        {
+            type = Instruction::Type::SUBTRACT;
+        }
+        else
+        {
+            return;
+        }
+
+        parse_product(definition, ++pos);
+        program_.push_back({ type });
+    }
+}
+
+void DerivedMetric::parse_product(const std::string& definition, std::size_t& pos)
+{
+    parse_factor(definition, pos);
+
+    for (skip_space(definition, pos); pos < definition.size(); skip_space(definition, pos))
+    {
+        Instruction::Type type;
+        if (definition[pos] == '*')
+        {
+            type = Instruction::Type::MULTIPLY;
+        }
+        else if (definition[pos] == '/')
+        {
+            type = Instruction::Type::DIVIDE;
+        }
+        else
+        {
+            return;
+        }
+
+        parse_factor(definition, ++pos);
+        program_.push_back({ type });
+    }
+}
+
+void DerivedMetric::parse_factor(const std::string& definition, std::size_t& pos)
+{
+    skip_space(definition, pos);
+
+    if (pos == definition.size())
+    {
+        throw InvalidExpression(definition, "unexpected end of expression");
+    }
+
+    char c = definition[pos];
+    if (c == '(')
+    {
+        parse_sum(definition, ++pos);
+        skip_space(definition, pos);
+
+        if (pos == definition.size() || definition[pos] != ')')
+        {
+            throw InvalidExpression(definition, "missing ')'");
+        }
+        pos++;
+    }
+    else if (c == '-')
+    {
+        parse_factor(definition, ++pos);
+        program_.push_back({ Instruction::Type::NEGATE });
+    }
+    else if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+    {
+        const char* begin = definition.c_str() + pos;
+        char* end;
+        double constant = std::strtod(begin, &end);
+
+        if (end == begin)
+        {
+            throw InvalidExpression(definition, "invalid number at '" + definition.substr(pos) +
+                                                    "'");
+        }
+        pos += end - begin;
+        program_.push_back({ Instruction::Type::CONSTANT, constant });
+    }
+    else if (is_name_char(c, true))
+    {
+        std::size_t begin = pos;
+        while (pos < definition.size() && is_name_char(definition[pos], false))
+        {
+            pos++;
+        }
+
+        std::string operand = definition.substr(begin, pos - begin);
+        auto it = std::find(operands_.begin(), operands_.end(), operand);
+        if (it == operands_.end())
+        {
+            it = operands_.insert(operands_.end(), operand);
+        }
+        program_.push_back(
+            { Instruction::Type::OPERAND, 0, static_cast<std::size_t>(it - operands_.begin()) });
+    }
+    else
+    {
+        throw InvalidExpression(definition, "unexpected '" + definition.substr(pos) + "'");
+    }
+}
+
+double DerivedMetric::evaluate(const std::vector<double>& operand_values) const
+{
+    stack_.clear();
+
+    for (const auto& instruction : program_)
+    {
+        if (instruction.type == Instruction::Type::CONSTANT)
+        {
+            stack_.push_back(instruction.constant);
+            continue;
+        }
+        if (instruction.type == Instruction::Type::OPERAND)
+        {
+            stack_.push_back(operand_values[instruction.operand]);
+            continue;
+        }
+        if (instruction.type == Instruction::Type::NEGATE)
+        {
+            stack_.back() = -stack_.back();
+            continue;
+        }
+
+        double rhs = stack_.back();
+        stack_.pop_back();
+        double& lhs = stack_.back();
+
+        switch (instruction.type)
+        {
+        case Instruction::Type::ADD:
+            lhs += rhs;
+            break;
+        case Instruction::Type::SUBTRACT:
+            lhs -= rhs;
+            break;
+        case Instruction::Type::MULTIPLY:
+            lhs *= rhs;
+            break;
+        case Instruction::Type::DIVIDE:
+            lhs /= rhs;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return std::isfinite(stack_.back()) ? stack_.back() : 0;
+}
+} // namespace counter
+} // namespace perf
+} // namespace lo2s
@@ -29,7 +29,9 @@
 #include <lo2s/perf/event_provider.hpp>
 #include <lo2s/perf/util.hpp>
 
+#include <cerrno>
 #include <cstring>
+#include <system_error>
 
 extern "C"
 {
@@ -48,10 +50,9 @@ namespace group
 {
 
 template <class T>
-Reader<T>::Reader(ExecutionScope scope, bool enable_on_exec)
+Reader<T>::Reader(ExecutionScope scope, bool enable_on_exec, SharedBufferReader* shared_buffer)
 : counter_collection_(
-      CounterProvider::instance().collection_for(MeasurementScope::group_metric(scope))),
-  counter_buffer_(counter_collection_.counters.size() + 1)
+      CounterProvider::instance().collection_for(MeasurementScope::group_metric(scope)))
 {
     if (config().metric_use_frequency)
     {
@@ -62,75 +63,95 @@ Reader<T>::Reader(ExecutionScope scope, bool enable_on_exec)
         counter_collection_.leader().sample_period(config().metric_count);
     }
 
-    do
+    if (config().flight_recorder)
+    {
+        counter_collection_.leader().write_backward();
+    }
+
+    for (std::size_t group = 0; group < counter_collection_.group_count(); group++)
     {
         try
         {
-            counter_leader_ =
-                counter_collection_.leader().open_as_group_leader(scope, config().cgroup_fd);
+            counter_leaders_.emplace_back(
+                counter_collection_.leader().open_as_group_leader(scope, config().cgroup_fd));
         }
         catch (const std::system_error& e)
         {
             // perf_try_event_open was used here before
-            if (counter_leader_.value().get_fd() < 0 && errno == EACCES &&
-                !counter_collection_.leader().attr().exclude_kernel && perf_event_paranoid() > 1)
-            {
-                counter_collection_.leader().mut_attr().exclude_kernel = 1;
-                perf_warn_paranoid();
-
-                continue;
-            }
-
-            if (!counter_leader_.value().is_valid())
+            if (e.code().value() != EACCES || counter_collection_.leader().attr().exclude_kernel ||
+                perf_event_paranoid() <= 1)
             {
                 Log::error() << "perf_event_open for counter group leader failed";
-                throw_errno();
+                throw;
             }
+
+            counter_collection_.leader().mut_attr().exclude_kernel = 1;
+            perf_warn_paranoid();
+
+            counter_leaders_.emplace_back(
+                counter_collection_.leader().open_as_group_leader(scope, config().cgroup_fd));
         }
-    } while (!counter_leader_.value().is_valid());
+
+        leader_ids_.emplace_back(counter_leaders_.back().get_id());
+        counter_buffers_.emplace_back(counter_collection_.group_size(group) + 1);
+    }
 
     Log::debug() << "counter::Reader: leader event: '" << counter_collection_.leader().name()
-                 << "'";
+                 << "', " << counter_leaders_.size() << " groups";
 
-    for (auto& counter_ev : counter_collection_.counters)
+    for (std::size_t group = 0; group < counter_collection_.group_count(); group++)
     {
-        if (counter_ev.is_available_in(scope))
+        auto begin = counter_collection_.counters.begin() + counter_collection_.group_start(group);
+        for (auto counter_ev = begin; counter_ev != begin + counter_collection_.group_size(group);
+             ++counter_ev)
         {
-            std::optional<EventGuard> counter = std::nullopt;
-            counter_ev.mut_attr().exclude_kernel =
+            counter_ev->mut_attr().exclude_kernel =
                 counter_collection_.leader().attr().exclude_kernel;
 
             try
             {
-                counter.value() = counter_leader_.value().open_child(counter_ev, scope);
-                counters_.emplace_back(std::move(counter.value()));
+                counters_.emplace_back(counter_leaders_[group].open_child(*counter_ev, scope));
             }
             catch (const std::system_error& e)
             {
-                if (!counter.value().is_valid())
+                Log::error() << "failed to add counter '" << counter_ev->name()
+                             << "': " << e.code().message();
+
+                if (e.code().value() == EINVAL)
                 {
-                    Log::error() << "failed to add counter '" << counter_ev.name()
-                                 << "': " << e.code().message();
-
-                    if (e.code().value() == EINVAL)
-                    {
-                        Log::error() << "opening " << counter_collection_.counters.size()
-                                     << " counters at once might exceed the hardware limit of "
-                                        "simultaneously "
-                                        "openable counters.";
-                    }
-                    throw e;
+                    Log::error() << "opening " << counter_collection_.group_size(group) + 1
+                                 << " counters at once might exceed the hardware limit of "
+                                    "simultaneously "
+                                    "openable counters.";
                 }
+                throw;
             }
         }
     }
 
-    if (!enable_on_exec)
+    if (shared_buffer != nullptr)
     {
-        counter_leader_.value().enable();
+        for (auto& leader : counter_leaders_)
+        {
+            shared_buffer->add(leader, *static_cast<T*>(this));
+        }
+    }
+    else
+    {
+        EventReader<T>::init_mmap(counter_leaders_.front().get_fd(), config().flight_recorder);
+        for (std::size_t group = 1; group < counter_leaders_.size(); group++)
+        {
+            counter_leaders_[group].set_output(counter_leaders_.front());
+        }
     }
 
-    EventReader<T>::init_mmap(counter_leader_.value().get_fd());
+    if (!enable_on_exec)
+    {
+        for (auto& leader : counter_leaders_)
+        {
+            leader.enable();
+        }
+    }
 }
 template class Reader<Writer>;
 } // namespace group
@@ -20,9 +20,13 @@
  */
 
 #include <lo2s/log.hpp>
+#include <lo2s/perf/counter/counter_provider.hpp>
 #include <lo2s/perf/counter/group/writer.hpp>
 #include <lo2s/time/time.hpp>
 
+#include <algorithm>
+#include <utility>
+
 namespace lo2s
 {
 namespace perf
@@ -31,33 +35,120 @@ namespace counter
 {
 namespace group
 {
-Writer::Writer(ExecutionScope scope, trace::Trace& trace, bool enable_on_exec)
-: Reader(scope, enable_on_exec), MetricWriter(MeasurementScope::group_metric(scope), trace)
+Writer::Writer(ExecutionScope scope, trace::Trace& trace, bool enable_on_exec,
+               SharedBufferReader* shared_buffer)
+: Reader(scope, enable_on_exec, shared_buffer),
+  MetricWriter(MeasurementScope::group_metric(scope), trace),
+  derived_metrics_(CounterProvider::instance().derived_metrics()),
+  current_(counter_collection_.counters.size() + 1, 0),
+  previous_(counter_collection_.counters.size() + 1, 0),
+  deltas_(current_.size() + 2, 0)
 {
+    for (const auto& metric : derived_metrics_)
+    {
+        auto& operands = derived_operands_.emplace_back();
+        for (const auto& operand : metric.operands())
+        {
+            if (operand == DerivedMetric::TIME)
+            {
+                operands.emplace_back(current_.size());
+            }
+            else if (operand == counter_collection_.leader().name())
+            {
+                operands.emplace_back(0);
+            }
+            else
+            {
+                auto it = std::find_if(counter_collection_.counters.begin(),
+                                       counter_collection_.counters.end(),
+                                       [&operand](const auto& ev) { return ev.name() == operand; });
+                if (it == counter_collection_.counters.end())
+                {
+                    Log::debug() << "derived metric " << metric.name() << ": '" << operand
+                                 << "' is not available in " << scope.name() << ", using 0";
+                    operands.emplace_back(current_.size() + 1);
+                }
+                else
+                {
+                    operands.emplace_back(it - counter_collection_.counters.begin() + 1);
+                }
+            }
+        }
+        operand_values_.emplace_back(operands.size(), 0);
+    }
 }
 
 bool Writer::handle(const Reader::RecordSampleType* sample)
 {
+    auto group = group_of(sample);
+    counter_buffers_[group].read(&sample->v);
+
+    // Every group samples on its own copy of the leader. Only the samples of the first group are
+    // written, the other groups contribute the values of their latest sample.
+    if (group != 0)
+    {
+        return false;
+    }
+
     // update event timestamp from sample
     metric_event_.timestamp(time_converter_(sample->time));
 
-    counter_buffer_.read(&sample->v);
+    // collect the counter values, the leader is only taken from the first group
+    current_[0] = counter_buffers_[0][0] * counter_collection_.get_scale(0);
+    for (group = 0; group < counter_buffers_.size(); group++)
+    {
+        const auto& counter_buffer = counter_buffers_[group];
+        auto offset = counter_collection_.group_start(group);
+
+        for (std::size_t i = 1; i < counter_buffer.size(); i++)
+        {
+            current_[offset + i] = counter_buffer[i] * counter_collection_.get_scale(offset + i);
+        }
+    }
 
     otf2::event::metric::values& values = metric_event_.raw_values();
+    std::size_t index = 0;
 
-    assert(counter_buffer_.size() <= values.size());
+    if (!CounterProvider::instance().derived_metrics_only())
+    {
+        for (; index < current_.size(); index++)
+        {
+            values[index] = current_[index];
+            suppressor_.set(index, current_[index]);
+        }
+        values[index++] = counter_buffers_[0].enabled();
+        values[index++] = counter_buffers_[0].running();
+    }
 
-    // read counter values into metric event
-    for (std::size_t i = 0; i < counter_buffer_.size(); i++)
+    if (!derived_metrics_.empty())
     {
-        values[i] = counter_buffer_[i] * counter_collection_.get_scale(i);
+        // derived metrics are computed from the change since the previous sample
+        for (std::size_t i = 0; i < current_.size(); i++)
+        {
+            deltas_[i] = current_[i] - previous_[i];
+        }
+        deltas_[current_.size()] =
+            previous_time_ == 0 ? 0 : (static_cast<double>(sample->time) - previous_time_) / 1e9;
+
+        for (std::size_t metric = 0; metric < derived_metrics_.size(); metric++)
+        {
+            auto& operand_values = operand_values_[metric];
+            for (std::size_t i = 0; i < operand_values.size(); i++)
+            {
+                operand_values[i] = deltas_[derived_operands_[metric][i]];
+            }
+            double value = derived_metrics_[metric].evaluate(operand_values);
+            values[index] = value;
+            suppressor_.set(index++, value);
+        }
+
+        std::swap(current_, previous_);
+        previous_time_ = sample->time;
     }
 
-    auto index = counter_buffer_.size();
-    values[index++] = counter_buffer_.enabled();
-    values[index++] = counter_buffer_.running();
+    assert(index == values.size());
 
-    writer_.write(metric_event_);
+    suppressor_.write(metric_event_);
     return false;
 }
 
@@ -20,6 +20,7 @@
  */
 
 #include <lo2s/error.hpp>
+#include <lo2s/log.hpp>
 #include <lo2s/perf/counter/userspace/reader.hpp>
 #include <lo2s/perf/counter/userspace/writer.hpp>
 #include <lo2s/perf/event.hpp>
@@ -28,10 +29,14 @@
 #include <lo2s/measurement_scope.hpp>
 #include <lo2s/perf/util.hpp>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
+#include <system_error>
 
 extern "C"
 {
+#include <sched.h>
 #include <unistd.h>
 }
 
@@ -43,44 +48,100 @@ namespace counter
 {
 namespace userspace
 {
+namespace
+{
+EventGuard open_counter(Event& event, ExecutionScope scope, EventGuard* leader)
+{
+    auto open = [&]() {
+        return leader != nullptr ? leader->open_child(event, scope) :
+                                   event.open_as_group_leader(scope);
+    };
+
+    try
+    {
+        return open();
+    }
+    catch (const std::system_error& e)
+    {
+        if (e.code().value() != EACCES || event.attr().exclude_kernel ||
+            perf_event_paranoid() <= 1)
+        {
+            throw;
+        }
+
+        event.mut_attr().exclude_kernel = 1;
+        perf_warn_paranoid();
+
+        return open();
+    }
+}
+} // namespace
+
 template <class T>
 Reader<T>::Reader(ExecutionScope scope)
 : counter_collection_(
       CounterProvider::instance().collection_for(MeasurementScope::userspace_metric(scope))),
   counter_buffer_(counter_collection_.counters.size()),
   timer_fd_(timerfd_from_ns(config().userspace_read_interval)),
+  group_buf_(std::make_unique<std::byte[]>(group::GroupReadFormat::total_size(
+      std::max<std::size_t>(counter_collection_.counters.size(), 1)))),
   data_(counter_collection_.counters.size())
 {
+    counters_.reserve(counter_collection_.counters.size());
+
     for (auto& event : counter_collection_.counters)
     {
-        std::optional<EventGuard> counter = std::nullopt;
+        // Add the counter to the current group. The kernel rejects group members with EINVAL if
+        // the group would no longer fit onto the PMU or if they belong to a different PMU, in
+        // that case the counter becomes the leader of a new group.
+        if (!group_starts_.empty())
+        {
+            try
+            {
+                counters_.emplace_back(
+                    open_counter(event, scope, &counters_[group_starts_.back()]));
+                continue;
+            }
+            catch (const std::system_error& e)
+            {
+                if (e.code().value() != EINVAL)
+                {
+                    Log::error() << "perf_event_open for counter failed";
+                    throw;
+                }
+            }
+        }
 
         try
         {
-            counter.value() = event.open(scope);
-            counters_.emplace_back(std::move(counter.value()));
+            counters_.emplace_back(open_counter(event, scope, nullptr));
+            group_starts_.emplace_back(counters_.size() - 1);
         }
-        catch (const std::system_error& e)
+        catch (const std::system_error&)
         {
-            // perf_try_event_open was used here before
-            if (counter.value().get_fd() < 0 && errno == EACCES && !event.attr().exclude_kernel &&
-                perf_event_paranoid() > 1)
-            {
-                event.mut_attr().exclude_kernel = 1;
-                perf_warn_paranoid();
+            Log::error() << "perf_event_open for counter failed";
+            throw;
+        }
+    }
 
-                counter = event.open(scope);
-            }
+    Log::debug() << "Opened " << counters_.size() << " userspace counters of " << scope.name()
+                 << " in " << group_starts_.size() << " groups";
 
-            if (!counter.value().is_valid())
-            {
-                Log::error() << "perf_event_open for counter failed";
-                throw_errno();
-            }
-            else
+    if (scope.is_cpu())
+    {
+        try
+        {
+            for (const auto& counter : counters_)
             {
-                counters_.emplace_back(std::move(counter.value()));
+                rdpmc_counters_.emplace_back(counter);
             }
+            rdpmc_cpu_ = scope.as_cpu().as_int();
+        }
+        catch (const std::system_error& e)
+        {
+            Log::debug() << "Could not mmap userspace counters of " << scope.name()
+                         << ", reading them with read(): " << e.what();
+            rdpmc_counters_.clear();
         }
     }
 }
@@ -88,9 +149,29 @@ Reader<T>::Reader(ExecutionScope scope)
 template <class T>
 void Reader<T>::read()
 {
-    for (std::size_t i = 0; i < counters_.size(); i++)
+    auto* group_data = reinterpret_cast<group::GroupReadFormat*>(group_buf_.get());
+
+    for (std::size_t group = 0; group < group_starts_.size(); group++)
     {
-        data_[i] = counters_[i].read<UserspaceReadFormat>();
+        std::size_t first = group_starts_[group];
+        std::size_t count = group_size(group);
+
+        if (!rdpmc_counters_.empty() && read_rdpmc(first, count))
+        {
+            continue;
+        }
+
+        if (::read(counters_[first].get_fd(), group_data,
+                   group::GroupReadFormat::total_size(count)) == -1)
+        {
+            throw_errno();
+        }
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            data_[first + i] = { group_data->values[i], group_data->time_enabled,
+                                 group_data->time_running };
+        }
     }
 
     static_cast<T*>(this)->handle(data_);
@@ -103,6 +184,27 @@ void Reader<T>::read()
     }
 }
 
+template <class T>
+bool Reader<T>::read_rdpmc(std::size_t first, std::size_t count)
+{
+    // rdpmc reads the counters of the CPU we are running on, which is usually, but not
+    // necessarily, the one we are pinned to. Check that we ran on rdpmc_cpu_ before and after
+    // reading, as the thread may migrate in between if it is not pinned.
+    if (sched_getcpu() != rdpmc_cpu_)
+    {
+        return false;
+    }
+
+    for (std::size_t i = first; i < first + count; i++)
+    {
+        if (!rdpmc_counters_[i].read(data_[i]))
+        {
+            return false;
+        }
+    }
+    return sched_getcpu() == rdpmc_cpu_;
+}
+
 template class Reader<Writer>;
 } // namespace userspace
 } // namespace counter
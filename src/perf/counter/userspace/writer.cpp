@@ -54,10 +54,12 @@ bool Writer::handle(std::vector<UserspaceReadFormat>& data)
     {
         // In get_scale, index 0 is reserved for the metric leader, which we don't have in the
         // userspace metric mode, so add 1 to the counter index
-        values[i] = counter_buffer_[i] * counter_collection_.get_scale(i + 1);
+        double value = counter_buffer_[i] * counter_collection_.get_scale(i + 1);
+        values[i] = value;
+        suppressor_.set(i, value);
     }
 
-    writer_.write(metric_event_);
+    suppressor_.write(metric_event_);
     return false;
 }
 
@@ -506,6 +506,8 @@ void SysfsEvent::use_sampling_options(const bool& use_pebs, const bool& sampling
 
     // TODO see if we can remove remove tid
     attr_.sample_type |= PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CPU;
+    // Allows for sharing the buffer with other events, see SharedBufferReader
+    attr_.sample_type |= PERF_SAMPLE_IDENTIFIER;
     if (enable_cct)
     {
         attr_.sample_type |= PERF_SAMPLE_CALLCHAIN;
@@ -537,11 +539,18 @@ EventGuard Event::open(ExecutionScope location, int cgroup_fd)
 EventGuard Event::open_as_group_leader(ExecutionScope location, int cgroup_fd)
 {
     attr_.read_format |= PERF_FORMAT_GROUP;
-    attr_.sample_type |= PERF_SAMPLE_READ;
+    attr_.sample_type |= PERF_SAMPLE_READ | PERF_SAMPLE_IDENTIFIER;
+    attr_.sample_id_all = 1;
 
     return open(location, cgroup_fd);
 }
 
+EventGuard Event::open_inherited(Process process, Cpu cpu)
+{
+    attr_.inherit = 1;
+    return EventGuard(*this, process, cpu);
+}
+
 EventGuard EventGuard::open_child(Event child, ExecutionScope location, int cgroup_fd)
 {
     if (location.is_cpu())
@@ -575,6 +584,22 @@ EventGuard::EventGuard(Event& ev, std::variant<Cpu, Thread> location, int group_
     }
 }
 
+EventGuard::EventGuard(Event& ev, Process process, Cpu cpu) : fd_(-1)
+{
+    fd_ = perf_event_open(&ev.mut_attr(), process, cpu, -1, 0);
+
+    if (fd_ < 0)
+    {
+        throw_errno();
+    }
+
+    if (fcntl(fd_, F_SETFL, O_NONBLOCK))
+    {
+        Log::error() << errno;
+        throw_errno();
+    }
+}
+
 void EventGuard::enable()
 {
     if (ioctl(fd_, PERF_EVENT_IOC_ENABLE) == -1)
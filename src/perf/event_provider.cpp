@@ -442,6 +442,11 @@ SysfsEvent EventProvider::create_sampling_event(bool enable_on_exec)
     event.sample_period(config().sampling_period);
     event.use_sampling_options(config().use_pebs, config().sampling, config().enable_cct);
 
+    if (config().flight_recorder)
+    {
+        event.write_backward();
+    }
+
     return event;
 }
 
@@ -53,14 +53,16 @@ namespace sample
 {
 
 Writer::Writer(ExecutionScope scope, monitor::MainMonitor& Monitor, trace::Trace& trace,
-               bool enable_on_exec)
-: Reader(scope, enable_on_exec), scope_(scope), monitor_(Monitor), trace_(trace),
+               bool enable_on_exec, SharedBufferReader* shared_buffer, Process inherit_process)
+: Reader(scope, enable_on_exec, shared_buffer, inherit_process), scope_(scope),
+  inherited_(inherit_process != Process::invalid()), monitor_(Monitor), trace_(trace),
   otf2_writer_(trace.sample_writer(scope)),
   cpuid_metric_instance_(trace.metric_instance(trace.cpuid_metric_class(), otf2_writer_.location(),
                                                otf2_writer_.location())),
   cpuid_metric_event_(otf2::chrono::genesis(), cpuid_metric_instance_), cctx_manager_(trace),
   time_converter_(perf::time::Converter::instance()), first_time_point_(lo2s::time::now()),
-  last_time_point_(first_time_point_)
+  last_time_point_(first_time_point_),
+  next_cctx_hand_off_(first_time_point_ + config().cctx_merge_interval)
 {
 }
 
@@ -93,6 +95,15 @@ bool Writer::handle(const Reader::RecordSampleType* sample)
                                                   cctx_manager_.sample_ref(sample->nr, sample->ips),
                                                   sample->nr, trace_.interrupt_generator().ref());
     }
+
+    if (config().cctx_merge_interval.count() > 0 && tp >= next_cctx_hand_off_)
+    {
+        // The merger needs the memory maps to resolve the new calling contexts
+        monitor_.insert_cached_mmap_events(cached_mmap_events_);
+        cached_mmap_events_.clear();
+        cctx_manager_.hand_off();
+        next_cctx_hand_off_ = tp + config().cctx_merge_interval;
+    }
     return false;
 }
 
@@ -165,7 +176,7 @@ bool Writer::handle(const Reader::RecordSwitchCpuWideType* context_switch)
 
 bool Writer::handle(const Reader::RecordSwitchType* context_switch)
 {
-    assert(!scope_.is_cpu());
+    assert(!scope_.is_cpu() || inherited_);
     auto tp = time_converter_(context_switch->time);
     tp = adjust_timepoints(tp);
 
@@ -173,6 +184,11 @@ bool Writer::handle(const Reader::RecordSwitchType* context_switch)
     update_calling_context(Process(context_switch->pid), Thread(context_switch->tid), tp,
                            is_switch_out);
 
+    if (scope_.is_cpu())
+    {
+        return false;
+    }
+
     cpuid_metric_event_.timestamp(tp);
     cpuid_metric_event_.raw_values()[0] =
         is_switch_out ? -1 : static_cast<std::int64_t>(context_switch->cpu);
@@ -199,9 +215,45 @@ void Writer::update_calling_context(Process process, Thread thread, otf2::chrono
     }
 }
 
+bool Writer::handle(const Reader::RecordForkType* fork)
+{
+    if (!inherited_)
+    {
+        return false;
+    }
+
+    Log::debug() << "Thread " << fork->tid << " in process " << fork->pid << " created by "
+                 << fork->ptid;
+
+    // The child keeps the name of its parent until it gets a comm record of its own
+    auto parent = comms_.find(Thread(fork->ptid));
+    if (parent != comms_.end())
+    {
+        comms_.emplace(Thread(fork->tid), parent->second);
+    }
+    return false;
+}
+
+bool Writer::handle_exit(const Reader::RecordExitType* exit)
+{
+    if (!inherited_)
+    {
+        return false;
+    }
+
+    // The events of an exiting thread are gone before it is switched out for the last time, so
+    // this is the last we get to see of it.
+    auto tp = adjust_timepoints(time_converter_(exit->time));
+    if (!cctx_manager_.thread_changed(Thread(exit->tid)))
+    {
+        leave_current_thread(Thread(exit->tid), tp);
+    }
+    return false;
+}
+
 bool Writer::handle(const Reader::RecordCommType* comm)
 {
-    if (!scope_.is_cpu())
+    if (!scope_.is_cpu() || inherited_)
     {
         std::string new_command{ static_cast<const char*>(comm->comm) };
 
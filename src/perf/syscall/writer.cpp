@@ -11,8 +11,8 @@ namespace perf
 namespace syscall
 {
 
-Writer::Writer(Cpu cpu, trace::Trace& trace)
-: Reader(cpu), trace_(trace), time_converter_(perf::time::Converter::instance()),
+Writer::Writer(Cpu cpu, trace::Trace& trace, SharedBufferReader* shared_buffer)
+: Reader(cpu, shared_buffer), trace_(trace), time_converter_(perf::time::Converter::instance()),
   writer_(trace.syscall_writer(cpu)), last_syscall_nr_(-1)
 {
 }
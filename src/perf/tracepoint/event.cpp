@@ -20,7 +20,8 @@
  */
 
 #include <lo2s/perf/tracepoint/event.hpp>
-#include <regex>
+
+#include <lo2s/line_scanner.hpp>
 
 namespace lo2s
 {
@@ -57,7 +58,7 @@ void TracepointEvent::parse_format()
     std::replace(name_.begin(), name_.end(), ':', '/');
 
     std::filesystem::path path_event = base_path_ / name_;
-    std::ifstream ifs_id, ifs_format;
+    std::ifstream ifs_id;
 
     auto id_path = path_event / "id";
     auto format_path = path_event / "format";
@@ -70,54 +71,72 @@ void TracepointEvent::parse_format()
         throw ParseError{ "Failed to read tracepoint ID file "s + id_path.string(), errno };
     }
 
-    ifs_format.open(format_path);
+    LineScanner format(format_path);
 
-    if (ifs_format.fail())
+    if (!format.ok())
     {
-        throw ParseError{ "Failed to open tracepoint format file "s + format_path.string(), errno };
+        throw ParseError{ "Failed to read tracepoint format file "s + format_path.string(), errno };
     }
 
-    std::string line;
-    while (std::getline(ifs_format, line))
+    std::string_view line;
+    while (format.next(line))
     {
         parse_format_line(line);
     }
-
-    if (ifs_format.bad())
-    {
-        throw ParseError{ "Unexpected error while reading tracepoint format description" };
-    }
 }
 
-void TracepointEvent::parse_format_line(const std::string& line)
+void TracepointEvent::parse_format_line(std::string_view line)
 {
-    static std::regex field_regex(
-        "^\\s+field:([^;]+);\\s+offset:(\\d+);\\s+size:(\\d+);\\s+signed:(\\d+);$");
-    static std::regex type_name_regex("^(.*) ([^ \\[\\]]+)(\\[[^\\]]+\\])?$");
-
-    std::smatch field_match;
-    if (!std::regex_match(line, field_match, field_regex))
+    // Field lines look like this:
+    //   <tab>field:<type> <name>[<array size>];<tab>offset:<n>;<tab>size:<n>;<tab>signed:<n>;
+    auto rest = line;
+    uint64_t offset, size, is_signed;
+    std::string_view param;
+
+    scan::skip_spaces(rest);
+    bool is_field = rest.size() < line.size() && scan::consume(rest, "field:");
+    if (is_field)
+    {
+        auto param_end = rest.find(';');
+        is_field = param_end != std::string_view::npos;
+        if (is_field)
+        {
+            param = rest.substr(0, param_end);
+            rest.remove_prefix(param_end + 1);
+        }
+    }
+    auto number_field = [&rest](std::string_view key, uint64_t& value) {
+        scan::skip_spaces(rest);
+        return scan::consume(rest, key) && scan::number(rest, value) && scan::consume(rest, ';');
+    };
+    if (!is_field || !number_field("offset:", offset) || !number_field("size:", size) ||
+        !number_field("signed:", is_signed) || !rest.empty())
     {
         Log::trace() << "Discarding line from parsing " << name_ << "/format: " << line;
         return;
     }
 
-    std::string param = field_match[1];
-    auto offset = stol(field_match[2]);
-    auto size = stol(field_match[3]);
-
-    std::smatch type_name_match;
-    if (!std::regex_match(param, type_name_match, type_name_regex))
+    // The name is the last word of param, without the array size
+    auto name_begin = param.rfind(' ');
+    std::string_view name;
+    if (name_begin != std::string_view::npos)
+    {
+        name = param.substr(name_begin + 1);
+        if (!name.empty() && name.back() == ']')
+        {
+            name = name.substr(0, name.find('['));
+        }
+    }
+    if (name.empty() || name.find_first_of("[]") != std::string_view::npos)
     {
         Log::warn() << "Could not parse type/name of tracepoint event field line for " << name_
                     << ", " << line;
         return;
     }
 
-    std::string name = type_name_match[2];
-    tracepoint::EventField field(name, offset, size);
+    tracepoint::EventField field(std::string(name), offset, size);
 
-    if (!nitro::lang::starts_with(name, "common_"))
+    if (!nitro::lang::starts_with(field.name(), "common_"))
     {
         fields_.emplace_back(field);
     }
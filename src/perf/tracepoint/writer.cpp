@@ -21,7 +21,7 @@ Writer::Writer(Cpu cpu, const std::string& name, trace::Trace& trace_,
   metric_instance_(
       trace_.metric_instance(metric_class, writer_.location(), trace_.system_tree_cpu_node(cpu))),
   time_converter_(perf::time::Converter::instance()),
-  metric_event_(otf2::chrono::genesis(), metric_instance_)
+  metric_event_(otf2::chrono::genesis(), metric_instance_), suppressor_(writer_)
 {
 }
 
@@ -37,9 +37,11 @@ bool Writer::handle(const Reader::RecordSampleType* sample)
             continue;
         }
 
-        metric_event_.raw_values()[index++] = sample->raw_data.get(field);
+        auto value = sample->raw_data.get(field);
+        metric_event_.raw_values()[index] = value;
+        suppressor_.set(index++, value);
     }
-    writer_.write(metric_event_);
+    suppressor_.write(metric_event_);
     return false;
 }
 } // namespace tracepoint
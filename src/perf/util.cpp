@@ -49,6 +49,13 @@ int perf_event_open(struct perf_event_attr* perf_attr, ExecutionScope scope, int
     return syscall(__NR_perf_event_open, perf_attr, pid, cpuid, group_fd, flags);
 }
 
+int perf_event_open(struct perf_event_attr* perf_attr, Process process, Cpu cpu, int group_fd,
+                    unsigned long flags)
+{
+    return syscall(__NR_perf_event_open, perf_attr, process.as_pid_t(), cpu.as_int(), group_fd,
+                   flags);
+}
+
 void perf_warn_paranoid()
 {
     static bool warning_issued = false;
@@ -0,0 +1,430 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/bfd_resolve.hpp>
+#include <lo2s/deferred_symbols.hpp>
+#include <lo2s/line_info.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/symbol_cache.hpp>
+
+#include <otf2xx/otf2.hpp>
+#include <otf2xx/reader/callback.hpp>
+#include <otf2xx/reader/reader.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdlib>
+
+namespace lo2s
+{
+namespace resolve
+{
+
+// Finds the measured binary, either at its original path or below one of the sysroots
+static std::optional<std::string> locate(const DeferredSymbols::Binary& binary,
+                                         const std::vector<std::string>& sysroots)
+{
+    std::vector<std::string> candidates;
+    for (const auto& sysroot : sysroots)
+    {
+        candidates.emplace_back(sysroot + binary.path);
+    }
+    candidates.emplace_back(binary.path);
+
+    for (const auto& candidate : candidates)
+    {
+        if (!std::filesystem::is_regular_file(candidate))
+        {
+            continue;
+        }
+        if (binary.build_id.empty() || read_build_id(candidate) == binary.build_id)
+        {
+            return candidate;
+        }
+        Log::warn() << candidate << " does not match the build-id of the measured binary";
+    }
+    return std::nullopt;
+}
+
+// Replacement for a placeholder string, with the line number of the resolved symbol
+struct Replacement
+{
+    std::string str;
+    unsigned int line;
+};
+
+// Resolves all deferred symbols using num_threads threads. The result is keyed by the function
+// and the file placeholder of each symbol.
+static std::unordered_map<std::string, Replacement>
+resolve_symbols(const std::vector<DeferredSymbols::Binary>& binaries,
+                const std::vector<std::string>& sysroots, std::size_t num_threads)
+{
+    struct Lookup
+    {
+        std::size_t binary;
+        std::optional<std::string> path;
+        Address offset;
+        LineInfo line_info;
+    };
+
+    std::vector<Lookup> lookups;
+    for (std::size_t i = 0; i < binaries.size(); i++)
+    {
+        auto path = locate(binaries[i], sysroots);
+        if (!path)
+        {
+            Log::warn() << "could not find " << binaries[i].path << ", its symbols stay unresolved";
+        }
+        for (auto offset : binaries[i].offsets)
+        {
+            lookups.push_back(
+                Lookup{ i, path, offset, LineInfo::for_unknown_function_in_dso(binaries[i].path) });
+        }
+    }
+
+    // Chunks never span two binaries, so that every thread opens as few binaries as possible
+    static constexpr std::size_t CHUNK_SIZE = 1024;
+    std::vector<std::pair<std::size_t, std::size_t>> chunks;
+    for (std::size_t begin = 0; begin < lookups.size();)
+    {
+        auto end = begin;
+        while (end < lookups.size() && end - begin < CHUNK_SIZE &&
+               lookups[end].binary == lookups[begin].binary)
+        {
+            end++;
+        }
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+
+    std::atomic<std::size_t> next_chunk = 0;
+    auto worker = [&lookups, &chunks, &binaries, &next_chunk]() {
+        // bfdr::Lib is not thread-safe, so every thread opens the binaries it needs itself
+        std::map<std::string, std::unique_ptr<bfdr::Lib>> libs;
+        for (auto chunk = next_chunk++; chunk < chunks.size(); chunk = next_chunk++)
+        {
+            for (auto i = chunks[chunk].first; i < chunks[chunk].second; i++)
+            {
+                auto& lookup = lookups[i];
+                if (!lookup.path)
+                {
+                    continue;
+                }
+
+                try
+                {
+                    auto& lib = libs[*lookup.path];
+                    if (!lib)
+                    {
+                        lib = std::make_unique<bfdr::Lib>(*lookup.path);
+                    }
+                    auto line_info = lib->lookup(lookup.offset);
+                    // Keep the name of the measured binary, not the one it was found under
+                    lookup.line_info =
+                        LineInfo::for_function(line_info.file.c_str(), line_info.function.c_str(),
+                                               line_info.line, binaries[lookup.binary].path);
+                }
+                catch (bfdr::LookupError&)
+                {
+                }
+                catch (std::exception& e)
+                {
+                    Log::warn() << "could not open " << *lookup.path << ": " << e.what();
+                    lookup.path.reset();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < std::min(num_threads, chunks.size()); i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::unordered_map<std::string, Replacement> resolved;
+    for (const auto& lookup : lookups)
+    {
+        const auto& binary = binaries[lookup.binary].path;
+        resolved.emplace(DeferredSymbols::function_placeholder(binary, lookup.offset),
+                         Replacement{ lookup.line_info.function, lookup.line_info.line });
+        resolved.emplace(DeferredSymbols::file_placeholder(binary, lookup.offset),
+                         Replacement{ lookup.line_info.file, lookup.line_info.line });
+    }
+    return resolved;
+}
+
+/**
+ * Copies all global definitions into a new archive, with the placeholders replaced.
+ *
+ * Only the contents of the placeholder strings and the line numbers of the regions and source
+ * code locations that use them change. So all references stay the same and the event and local
+ * definition files of the trace remain valid.
+ */
+class Rewriter : public otf2::reader::callback
+{
+public:
+    Rewriter(otf2::writer::archive& archive,
+             const std::unordered_map<std::string, Replacement>& resolved)
+    : archive_(archive), resolved_(resolved)
+    {
+    }
+
+    std::size_t num_replaced() const
+    {
+        return num_replaced_;
+    }
+
+    void definition(const otf2::definition::string& def) override
+    {
+        auto it = resolved_.find(def.str());
+        if (it == resolved_.end())
+        {
+            archive_ << def;
+            return;
+        }
+
+        num_replaced_++;
+        archive_ << otf2::definition::string(def.ref(), it->second.str);
+    }
+
+    void definition(const otf2::definition::region& def) override
+    {
+        auto it = resolved_.find(def.name().str());
+        if (it == resolved_.end())
+        {
+            archive_ << def;
+            return;
+        }
+
+        archive_ << otf2::definition::region(def.ref(), def.name(), def.canonical_name(),
+                                             def.description(), def.role(), def.paradigm(),
+                                             def.flags(), def.source_file(), it->second.line,
+                                             it->second.line);
+    }
+
+    void definition(const otf2::definition::source_code_location& def) override
+    {
+        auto it = resolved_.find(def.file().str());
+        if (it == resolved_.end())
+        {
+            archive_ << def;
+            return;
+        }
+
+        archive_ << otf2::definition::source_code_location(def.ref(), def.file(),
+                                                           it->second.line);
+    }
+
+    // All other definitions that lo2s writes are copied as they are
+    void definition(const otf2::definition::clock_properties& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::system_tree_node& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::system_tree_node_property& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::system_tree_node_domain& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::location_group& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::location& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::calling_context& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::calling_context_property& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::interrupt_generator& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::regions_group& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::comm_group& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::comm_locations_group& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::comm& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::metric_member& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::metric_class& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::metric_instance& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::io_paradigm& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::io_regular_file& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::io_handle& def) override
+    {
+        archive_ << def;
+    }
+    void definition(const otf2::definition::io_pre_created_handle_state& def) override
+    {
+        archive_ << def;
+    }
+
+private:
+    otf2::writer::archive& archive_;
+    const std::unordered_map<std::string, Replacement>& resolved_;
+    std::size_t num_replaced_ = 0;
+};
+
+static void usage()
+{
+    std::cerr << "Usage: lo2s-resolve [-j THREADS] [-s SYSROOT]... TRACE_DIR\n\n"
+              << "Resolves the symbols of a trace recorded with lo2s --defer-symbols.\n"
+              << "  -j THREADS  number of threads (default: number of cores)\n"
+              << "  -s SYSROOT  also search binaries below SYSROOT, e.g. an unpacked image\n";
+}
+
+static int run(int argc, const char** argv)
+{
+    std::size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> sysroots;
+    std::string trace_dir;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if ((arg == "-j" || arg == "-s") && i + 1 < argc)
+        {
+            if (arg == "-j")
+            {
+                num_threads = std::max(1UL, std::stoul(argv[++i]));
+            }
+            else
+            {
+                sysroots.emplace_back(argv[++i]);
+            }
+        }
+        else if (trace_dir.empty() && arg[0] != '-')
+        {
+            trace_dir = arg;
+        }
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (trace_dir.empty())
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    auto binaries = DeferredSymbols::read(trace_dir);
+    auto resolved = resolve_symbols(binaries, sysroots, num_threads);
+
+    std::filesystem::path trace_path(trace_dir);
+    auto tmp_path = trace_path;
+    tmp_path += ".resolve";
+    std::filesystem::remove_all(tmp_path);
+
+    std::size_t num_replaced;
+    {
+        otf2::writer::archive archive(tmp_path.string(), "traces");
+        Rewriter rewriter(archive, resolved);
+
+        otf2::reader::reader reader((trace_path / "traces.otf2").string());
+        reader.set_callback(rewriter);
+        reader.read_definitions();
+        num_replaced = rewriter.num_replaced();
+    }
+
+    // Only the global definitions changed, the anchor file still matches them
+    std::filesystem::rename(tmp_path / "traces.def", trace_path / "traces.def");
+    std::filesystem::remove_all(tmp_path);
+    // Running lo2s-resolve again would not find the placeholders anymore
+    auto sidecar_path = trace_path / DeferredSymbols::SIDECAR_FILENAME;
+    auto done_path = sidecar_path;
+    done_path += ".done";
+    std::filesystem::rename(sidecar_path, done_path);
+
+    Log::info() << "Resolved " << num_replaced << " symbol strings of " << binaries.size()
+                << " binaries in " << trace_dir;
+    return EXIT_SUCCESS;
+}
+} // namespace resolve
+} // namespace lo2s
+
+int main(int argc, const char** argv)
+{
+    try
+    {
+        return lo2s::resolve::run(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        lo2s::Log::fatal() << "Aborting: " << e.what();
+        return EXIT_FAILURE;
+    }
+}
@@ -26,7 +26,9 @@ Summary& summary()
 }
 
 Summary::Summary()
-: start_wall_time_(std::chrono::steady_clock::now()), num_wakeups_(0), thread_count_(0),
+: start_wall_time_(std::chrono::steady_clock::now()), cctx_merge_time_(0), num_wakeups_(0),
+  num_perf_batches_(0), num_perf_batch_records_(0), num_reordered_events_(0),
+  num_late_events_(0), thread_count_(0),
   exit_code_(0)
 {
 }
@@ -42,6 +44,23 @@ void Summary::record_perf_wakeups(std::size_t num_wakeups)
     num_wakeups_ += num_wakeups;
 }
 
+void Summary::record_perf_batches(std::size_t num_batches, std::size_t num_records)
+{
+    num_perf_batches_ += num_batches;
+    num_perf_batch_records_ += num_records;
+}
+
+void Summary::record_late_events(std::size_t num_reordered, std::size_t num_late)
+{
+    num_reordered_events_ += num_reordered;
+    num_late_events_ += num_late;
+}
+
+void Summary::record_cctx_merge(std::chrono::steady_clock::duration duration)
+{
+    cctx_merge_time_ = duration;
+}
+
 void Summary::set_exit_code(int exit_code)
 {
     exit_code_ = exit_code;
@@ -142,6 +161,25 @@ void Summary::show()
     }
     std::cout << num_wakeups_ << " wakeups, ";
 
+    if (num_perf_batches_ > 0)
+    {
+        std::cout << std::fixed << std::setprecision(1)
+                  << static_cast<double>(num_perf_batch_records_) / num_perf_batches_
+                  << " records/batch, " << std::defaultfloat;
+    }
+
+    if (cctx_merge_time_.count() > 0)
+    {
+        std::cout << std::chrono::duration<double>(cctx_merge_time_).count()
+                  << "s calling context merge, ";
+    }
+
+    if (num_reordered_events_ > 0)
+    {
+        std::cout << num_reordered_events_ << " events reordered (" << num_late_events_
+                  << " too late), ";
+    }
+
     if (trace_dir_ != "")
     {
         std::cout << "wrote " << pretty_print_bytes(trace_size) << " " << trace_dir_;
@@ -0,0 +1,380 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/symbol_cache.hpp>
+
+#include <lo2s/log.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <cstring>
+
+extern "C"
+{
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace lo2s
+{
+
+namespace
+{
+// Maps a whole file read-only, data is nullptr if that failed
+struct MappedFile
+{
+    MappedFile(const std::string& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                this->data = static_cast<const char*>(data);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    void release()
+    {
+        data = nullptr;
+        size = 0;
+    }
+
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
+
+template <class Ehdr, class Shdr, class Nhdr>
+std::optional<std::string> find_build_id(const char* data, std::size_t size)
+{
+    if (size < sizeof(Ehdr))
+    {
+        return std::nullopt;
+    }
+
+    auto ehdr = reinterpret_cast<const Ehdr*>(data);
+    if (ehdr->e_shoff == 0 || ehdr->e_shentsize != sizeof(Shdr) ||
+        ehdr->e_shoff + std::size_t(ehdr->e_shnum) * sizeof(Shdr) > size)
+    {
+        return std::nullopt;
+    }
+
+    auto shdrs = reinterpret_cast<const Shdr*>(data + ehdr->e_shoff);
+    for (std::size_t i = 0; i < ehdr->e_shnum; i++)
+    {
+        if (shdrs[i].sh_type != SHT_NOTE || shdrs[i].sh_offset + shdrs[i].sh_size > size)
+        {
+            continue;
+        }
+
+        auto align = [](std::size_t n) { return (n + 3) & ~std::size_t(3); };
+        std::size_t pos = shdrs[i].sh_offset;
+        std::size_t end = pos + shdrs[i].sh_size;
+        while (pos + sizeof(Nhdr) <= end)
+        {
+            auto nhdr = reinterpret_cast<const Nhdr*>(data + pos);
+            pos += sizeof(Nhdr);
+
+            const char* name = data + pos;
+            const unsigned char* desc =
+                reinterpret_cast<const unsigned char*>(name + align(nhdr->n_namesz));
+            pos += align(nhdr->n_namesz) + align(nhdr->n_descsz);
+            if (pos > end)
+            {
+                break;
+            }
+
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+                std::memcmp(name, "GNU", 4) == 0 && nhdr->n_descsz > 0)
+            {
+                std::string build_id;
+                for (std::size_t j = 0; j < nhdr->n_descsz; j++)
+                {
+                    build_id += fmt::format("{:02x}", static_cast<unsigned>(desc[j]));
+                }
+                return build_id;
+            }
+        }
+    }
+    return std::nullopt;
+}
+} // namespace
+
+std::optional<std::string> read_build_id(const std::string& filename)
+{
+    MappedFile file(filename);
+    if (file.data == nullptr || file.size < EI_NIDENT ||
+        std::memcmp(file.data, ELFMAG, SELFMAG) != 0)
+    {
+        return std::nullopt;
+    }
+
+    if (file.data[EI_CLASS] == ELFCLASS64)
+    {
+        return find_build_id<Elf64_Ehdr, Elf64_Shdr, Elf64_Nhdr>(file.data, file.size);
+    }
+    if (file.data[EI_CLASS] == ELFCLASS32)
+    {
+        return find_build_id<Elf32_Ehdr, Elf32_Shdr, Elf32_Nhdr>(file.data, file.size);
+    }
+    return std::nullopt;
+}
+
+struct SymbolCache::File::Header
+{
+    char magic[8];
+    uint64_t num_entries;
+    uint64_t strings_size;
+};
+
+struct SymbolCache::File::Entry
+{
+    uint64_t offset;
+    uint32_t file;
+    uint32_t function;
+    uint32_t line;
+    uint32_t reserved;
+};
+
+static constexpr char SYMBOL_CACHE_MAGIC[8] = { 'L', 'O', '2', 'S', 'S', 'Y', 'M', '1' };
+
+// The file of line infos without a source location, see LineInfo::for_function()
+static constexpr char UNKNOWN_FILE[] = "<unknown file>";
+
+SymbolCache::File::File(const std::string& filename) : filename_(filename)
+{
+    MappedFile file(filename);
+    if (file.data == nullptr)
+    {
+        return;
+    }
+
+    auto header = reinterpret_cast<const Header*>(file.data);
+    if (file.size < sizeof(Header) ||
+        std::memcmp(header->magic, SYMBOL_CACHE_MAGIC, sizeof(SYMBOL_CACHE_MAGIC)) != 0 ||
+        file.size != sizeof(Header) + header->num_entries * sizeof(Entry) + header->strings_size ||
+        header->strings_size == 0 || file.data[file.size - 1] != '\0')
+    {
+        Log::warn() << "ignoring invalid symbol cache file " << filename;
+        return;
+    }
+
+    data_ = const_cast<char*>(file.data);
+    size_ = file.size;
+    num_entries_ = header->num_entries;
+    file.release();
+}
+
+SymbolCache::File::~File()
+{
+    if (data_ != nullptr)
+    {
+        munmap(data_, size_);
+    }
+}
+
+const SymbolCache::File::Entry* SymbolCache::File::entries() const
+{
+    if (data_ == nullptr)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<const Entry*>(static_cast<const char*>(data_) + sizeof(Header));
+}
+
+const char* SymbolCache::File::string(uint32_t offset) const
+{
+    auto strings = reinterpret_cast<const char*>(entries() + num_entries_);
+    auto strings_size = reinterpret_cast<const Header*>(data_)->strings_size;
+    return strings + std::min<uint64_t>(offset, strings_size - 1);
+}
+
+std::optional<LineInfo> SymbolCache::File::lookup(Address offset, const std::string& dso)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    auto it = added_.find(offset);
+    if (it != added_.end())
+    {
+        return LineInfo::for_function(it->second.file.c_str(), it->second.function.c_str(),
+                                      it->second.line, dso);
+    }
+
+    auto end = entries() + num_entries_;
+    auto entry = std::lower_bound(entries(), end, offset.value(),
+                                  [](const Entry& e, uint64_t o) { return e.offset < o; });
+    if (entry == end || entry->offset != offset.value())
+    {
+        return std::nullopt;
+    }
+    return LineInfo::for_function(string(entry->file), string(entry->function), entry->line, dso);
+}
+
+void SymbolCache::File::insert(Address offset, const LineInfo& line_info)
+{
+    // Failed lookups and binaries whose separate debug info is not installed yet give no source
+    // location. Installing the debug info does not change the build-id, so caching such results
+    // would hide the line info in all later runs.
+    if (line_info.file == UNKNOWN_FILE)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    added_.emplace(offset, line_info);
+}
+
+void SymbolCache::File::write()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (added_.empty())
+    {
+        return;
+    }
+
+    std::vector<Entry> entries;
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> string_offsets;
+    auto intern = [&strings, &string_offsets](const std::string& str) {
+        auto r = string_offsets.try_emplace(str, strings.size());
+        if (r.second)
+        {
+            strings.append(str);
+            strings.push_back('\0');
+        }
+        return r.first->second;
+    };
+
+    // Merge the sorted entries of the old file with the sorted new ones
+    auto old_it = this->entries();
+    auto old_end = old_it + num_entries_;
+    for (auto new_it = added_.begin(); old_it != old_end || new_it != added_.end();)
+    {
+        if (new_it == added_.end() || (old_it != old_end && old_it->offset < new_it->first.value()))
+        {
+            entries.push_back(Entry{ old_it->offset, intern(string(old_it->file)),
+                                     intern(string(old_it->function)), old_it->line, 0 });
+            ++old_it;
+        }
+        else
+        {
+            if (old_it != old_end && old_it->offset == new_it->first.value())
+            {
+                ++old_it;
+            }
+            entries.push_back(Entry{ new_it->first.value(), intern(new_it->second.file),
+                                     intern(new_it->second.function), new_it->second.line, 0 });
+            ++new_it;
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, SYMBOL_CACHE_MAGIC, sizeof(SYMBOL_CACHE_MAGIC));
+    header.num_entries = entries.size();
+    header.strings_size = strings.size();
+
+    try
+    {
+        std::filesystem::path path(filename_);
+        std::filesystem::create_directories(path.parent_path());
+
+        auto tmp_path = path;
+        tmp_path += fmt::format(".{}.tmp", getpid());
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(entries.data()),
+                      entries.size() * sizeof(Entry));
+            out.write(strings.data(), strings.size());
+            if (!out)
+            {
+                std::filesystem::remove(tmp_path);
+                throw std::runtime_error("could not write " + tmp_path.string());
+            }
+        }
+        std::filesystem::rename(tmp_path, path);
+        Log::debug() << "wrote " << entries.size() << " entries to symbol cache " << filename_;
+    }
+    catch (std::exception& e)
+    {
+        Log::warn() << "failed to update symbol cache: " << e.what();
+    }
+}
+
+SymbolCache::File* SymbolCache::open(const std::string& binary)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (directory_.empty())
+    {
+        return nullptr;
+    }
+
+    auto build_id = read_build_id(binary);
+    if (!build_id)
+    {
+        Log::debug() << "not caching symbols of " << binary << ", as it has no build-id";
+        return nullptr;
+    }
+
+    auto& file = files_[*build_id];
+    if (!file)
+    {
+        file = std::make_unique<File>(directory_ + "/" + *build_id);
+    }
+    return file.get();
+}
+
+void SymbolCache::flush()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto& file : files_)
+    {
+        file.second->write();
+    }
+}
+} // namespace lo2s
@@ -0,0 +1,220 @@
+/*
+ * This file is part of the lo2s software.
+ * Linux OTF2 sampling
+ *
+ * Copyright (c) 2024,
+ *    Technische Universitaet Dresden, Germany
+ *
+ * lo2s is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lo2s is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lo2s.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lo2s/task_controller.hpp>
+
+#include <lo2s/config.hpp>
+#include <lo2s/error.hpp>
+#include <lo2s/log.hpp>
+#include <lo2s/summary.hpp>
+#include <lo2s/topology.hpp>
+#include <lo2s/trace/trace.hpp>
+#include <lo2s/util.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+extern "C"
+{
+#include <poll.h>
+#include <sys/wait.h>
+}
+
+namespace lo2s
+{
+
+TaskController::TaskController(Process child, const std::string& name,
+                               monitor::AbstractProcessMonitor& monitor)
+: first_child_(child), monitor_(monitor), default_signal_handler_(signal(SIGINT, SIG_IGN)),
+  num_wakeups_(0), groups_(ExecutionScopeGroup::instance())
+{
+    // Open these before anything else, so that we do not miss any fork of the child
+    for (const auto& cpu : Topology::instance().cpus())
+    {
+        readers_.emplace_back(std::make_unique<perf::TaskReader>(child, cpu, events_));
+    }
+
+    groups_.add_process(child);
+    known_threads_.emplace(child.as_thread());
+
+    monitor_.insert_process(trace::Trace::NO_PARENT_PROCESS, child, name, true);
+
+    summary().add_thread();
+}
+
+TaskController::~TaskController()
+{
+    signal(SIGINT, default_signal_handler_);
+    summary().record_perf_wakeups(num_wakeups_);
+}
+
+void TaskController::run()
+{
+    std::vector<struct pollfd> pfds;
+    for (const auto& reader : readers_)
+    {
+        pfds.push_back({ reader->fd(), POLLIN, 0 });
+    }
+
+    // The child stopped itself right before exec, so that all events are set up in time
+    if (kill(first_child_.as_pid_t(), SIGCONT) == -1)
+    {
+        Log::error() << "Failed to continue " << first_child_;
+        throw_errno();
+    }
+
+    // The exit of the child is not reported via the perf buffers, so check for it regularly
+    auto timeout =
+        std::chrono::duration_cast<std::chrono::milliseconds>(config().read_interval).count();
+    while (true)
+    {
+        if (::poll(pfds.data(), pfds.size(), static_cast<int>(timeout)) == -1 && errno != EINTR)
+        {
+            throw_errno();
+        }
+        num_wakeups_++;
+
+        int status;
+        auto ret = waitpid(first_child_.as_pid_t(), &status, WNOHANG);
+        if (ret == -1 && errno != EINTR)
+        {
+            throw_errno();
+        }
+
+        // If the child exited, everything it did is in the buffers by now
+        read_and_dispatch();
+
+        if (ret == first_child_.as_pid_t())
+        {
+            if (WIFEXITED(status))
+            {
+                Log::info() << first_child_ << " exiting with status " << WEXITSTATUS(status);
+                summary().set_exit_code(WEXITSTATUS(status));
+            }
+            else if (WIFSIGNALED(status))
+            {
+                Log::info() << first_child_ << " exited due to signal " << WTERMSIG(status);
+            }
+            else
+            {
+                // stopped or continued by someone else
+                continue;
+            }
+
+            std::cout << "[ lo2s: Child exited. Stopping measurements and closing trace. ]"
+                      << std::endl;
+            return;
+        }
+    }
+}
+
+void TaskController::read_and_dispatch()
+{
+    for (auto& reader : readers_)
+    {
+        reader->read();
+    }
+
+    std::stable_sort(events_.begin(), events_.end(),
+                     [](const auto& a, const auto& b) { return a.time < b.time; });
+
+    auto retry_exits = std::move(pending_exits_);
+    pending_exits_.clear();
+
+    for (const auto& event : events_)
+    {
+        dispatch(event, true);
+    }
+    events_.clear();
+
+    for (const auto& event : retry_exits)
+    {
+        dispatch(event, false);
+    }
+}
+
+void TaskController::dispatch(const perf::TaskEvent& event, bool defer_unknown_exit)
+{
+    switch (event.type)
+    {
+    case perf::TaskEvent::Type::FORK:
+    {
+        if (!known_threads_.emplace(event.thread).second)
+        {
+            break;
+        }
+
+        if (event.thread == event.process.as_thread())
+        {
+            std::string command = get_process_comm(event.process);
+            Log::debug() << "New " << event.process << " (" << command << "): forked from "
+                         << event.parent_thread;
+
+            groups_.add_process(event.process);
+            monitor_.insert_process(event.parent_process, event.process, command);
+        }
+        else
+        {
+            std::string command = get_task_comm(event.process, event.thread);
+            Log::info() << "New " << event.thread << " (" << command << "): cloned from "
+                        << event.parent_thread << " in " << event.process;
+
+            groups_.add_thread(event.thread, event.process);
+            monitor_.insert_thread(event.process, event.thread, command);
+        }
+        summary().add_thread();
+    }
+    break;
+    case perf::TaskEvent::Type::EXIT:
+    {
+        if (known_threads_.count(event.thread) == 0)
+        {
+            if (defer_unknown_exit)
+            {
+                pending_exits_.push_back(event);
+            }
+            else
+            {
+                Log::debug() << event.thread << " exited, but was never seen before.";
+            }
+            break;
+        }
+
+        Log::info() << "Thread " << event.thread << " exited";
+        known_threads_.erase(event.thread);
+        monitor_.exit_thread(event.thread);
+    }
+    break;
+    case perf::TaskEvent::Type::EXEC:
+        Log::debug() << "Exec in " << event.thread << " (" << event.comm << ")";
+        monitor_.update_process_name(event.process, event.comm);
+        break;
+    case perf::TaskEvent::Type::COMM:
+        // Thread names are taken care of by the sampling events, see perf::sample::Writer
+        if (event.thread == event.process.as_thread())
+        {
+            monitor_.update_process_name(event.process, event.comm);
+        }
+        break;
+    }
+}
+} // namespace lo2s
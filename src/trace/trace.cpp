@@ -24,12 +24,14 @@
 #include <lo2s/address.hpp>
 #include <lo2s/bfd_resolve.hpp>
 #include <lo2s/config.hpp>
+#include <lo2s/deferred_symbols.hpp>
 #include <lo2s/line_info.hpp>
 #include <lo2s/mmap.hpp>
 #include <lo2s/monitor/main_monitor.hpp>
 #include <lo2s/perf/bio/block_device.hpp>
 #include <lo2s/perf/tracepoint/format.hpp>
 #include <lo2s/summary.hpp>
+#include <lo2s/symbol_cache.hpp>
 #include <lo2s/syscalls.hpp>
 #include <lo2s/time/time.hpp>
 #include <lo2s/topology.hpp>
@@ -48,6 +50,7 @@
 #include <mutex>
 #include <regex>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 
 namespace lo2s
@@ -184,12 +187,16 @@ Trace::Trace()
             intern("block devices"), otf2::common::paradigm_type::hardware,
             otf2::common::group_flag_type::none);
 
-        for (auto& device : get_block_devices())
+        // In histogram mode, metric writers are only created for devices that are actually used
+        if (!config().block_io_histogram)
         {
-            if (device.second.type == BlockDeviceType::DISK)
+            for (auto& device : get_block_devices())
             {
-                block_io_handle(device.second);
-                bio_writer(device.second);
+                if (device.second.type == BlockDeviceType::DISK)
+                {
+                    block_io_handle(device.second);
+                    bio_writer(device.second);
+                }
             }
         }
     }
@@ -230,6 +237,8 @@ otf2::chrono::time_point Trace::record_to() const
 
 Trace::~Trace()
 {
+    stop_cctx_merger();
+
     if (!cctx_refs_finalized_)
     {
         Log::error()
@@ -611,39 +620,186 @@ otf2::definition::metric_class& Trace::metric_class()
                                                             otf2::common::recorder_kind::abstract);
 }
 
-void Trace::merge_ips(const IpRefMap& new_children, IpCctxMap& children,
-                      std::vector<uint32_t>& mapping_table,
-                      otf2::definition::calling_context& parent,
-                      const std::map<Process, ProcessInfo>& infos, Process process)
+void Trace::resolve_ips(const std::vector<std::pair<ThreadCctxRefMap*, CctxDelta>>& deltas,
+                        const std::map<Process, ProcessInfo>& infos,
+                        std::map<Process, IpResolver>& resolvers)
 {
-    for (const auto& elem : new_children)
+    std::map<Process, std::set<Address>> process_ips;
+    for (const auto& delta : deltas)
+    {
+        auto& ips = process_ips[delta.second.process];
+        for (const auto& node : delta.second.nodes)
+        {
+            if (node.index != IpRefTree::ROOT)
+            {
+                ips.emplace(node.ip);
+            }
+        }
+    }
+
+    struct Lookup
+    {
+        IpResolver* resolver;
+        Address ip;
+        LineInfo line_info;
+    };
+
+    std::vector<Lookup> lookups;
+    for (const auto& ips : process_ips)
+    {
+        auto& resolver = resolvers.try_emplace(ips.first, infos, ips.first).first->second;
+        for (auto ip : ips.second)
+        {
+            lookups.push_back(Lookup{ &resolver, ip, LineInfo::for_unknown_function() });
+        }
+    }
+
+    // The lookups of a single binary are serialized, the parallelism comes from the different
+    // binaries. Small chunks keep the workers busy even if some binaries are expensive.
+    static constexpr std::size_t CHUNK_SIZE = 256;
+    std::size_t num_chunks = (lookups.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::size_t num_workers =
+        std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), num_chunks);
+
+    std::atomic<std::size_t> next_chunk = 0;
+    auto worker = [&lookups, &next_chunk, num_chunks]() {
+        for (auto chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+        {
+            auto end = std::min(lookups.size(), (chunk + 1) * CHUNK_SIZE);
+            for (auto i = chunk * CHUNK_SIZE; i < end; i++)
+            {
+                try
+                {
+                    lookups[i].line_info = lookups[i].resolver->resolve(lookups[i].ip);
+                }
+                catch (std::exception& e)
+                {
+                    Log::debug() << "could not resolve " << lookups[i].ip << ": " << e.what();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < num_workers; i++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+
+    for (const auto& lookup : lookups)
+    {
+        lookup.resolver->memoize(lookup.ip, lookup.line_info);
+    }
+
+    Log::debug() << "resolved " << lookups.size() << " distinct IPs using " << num_workers
+                 << " threads";
+}
+
+IpCctxTree& Trace::thread_calling_context_tree(Thread thread, Process process)
+{
+    groups_.add_thread(thread, process);
+
+    auto global_thread_cctx = calling_context_tree_.find(thread);
+    if (global_thread_cctx != calling_context_tree_.end())
+    {
+        return global_thread_cctx->second;
+    }
+
+    if (thread != Thread(0))
+    {
+        if (auto thread_name = thread_names_.find(thread); thread_name != thread_names_.end())
+        {
+            add_thread(thread, thread_name->second);
+        }
+        else
+        {
+            if (auto process_name = thread_names_.find(process.as_thread());
+                process_name != thread_names_.end())
+            {
+                add_thread(thread, process_name->second);
+            }
+            else
+            {
+                add_thread(thread, "<unknown thread>");
+            }
+        }
+    }
+    else
+    {
+        add_thread(thread, "<idle>");
+    }
+
+    global_thread_cctx = calling_context_tree_.find(thread);
+    assert(global_thread_cctx != calling_context_tree_.end());
+    return global_thread_cctx->second;
+}
+
+void Trace::prepend_pending(ThreadCctxRefMap& refs, CctxDelta& delta)
+{
+    auto& pending = refs.merged[delta.thread].pending;
+    if (!pending.empty())
+    {
+        delta.nodes.insert(delta.nodes.begin(), pending.begin(), pending.end());
+        pending.clear();
+    }
+}
+
+void Trace::merge_cctx_delta(ThreadCctxRefMap& refs, CctxDelta& delta, IpResolver& resolver,
+                             bool final)
+{
+    std::lock_guard<std::recursive_mutex> guard(mutex_);
+
+    auto& merged = refs.merged[delta.thread];
+    auto& tree = thread_calling_context_tree(delta.thread, delta.process);
+
+    for (const auto& local : delta.nodes)
     {
-        auto& ip = elem.first;
-        auto& local_ref = elem.second.ref;
-        auto& local_children = elem.second.children;
-        LineInfo line_info = LineInfo::for_unknown_function();
+        if (merged.global_nodes.size() <= local.index)
+        {
+            merged.global_nodes.resize(local.index + 1, ThreadCctxRefMap::PENDING);
+        }
+        if (refs.mappings.size() <= local.ref)
+        {
+            refs.mappings.resize(local.ref + 1, -1u);
+        }
+
+        if (local.index == IpRefTree::ROOT)
+        {
+            merged.global_nodes[local.index] = IpCctxTree::ROOT;
+            refs.mappings[local.ref] = tree.value(IpCctxTree::ROOT)->ref();
+            continue;
+        }
 
-        auto info_it = infos.find(process);
-        if (info_it != infos.end())
+        // Samples in a library that was mapped after the start of the measurement may be handed
+        // off before the corresponding mmap event
+        auto parent = merged.global_nodes[local.parent];
+        if (parent == ThreadCctxRefMap::PENDING || (!final && !resolver.is_mapped(local.ip)))
         {
-            MemoryMap maps = info_it->second.maps();
-            line_info = maps.lookup_line_info(ip);
+            merged.pending.push_back(local);
+            continue;
         }
 
+        auto ip = local.ip;
+        const LineInfo& line_info = resolver.lookup_line_info(ip);
+
         Log::trace() << "resolved " << ip << ": " << line_info;
-        auto cctx_it = children.find(ip);
-        if (cctx_it == children.end())
+        auto [node, inserted] = tree.emplace(parent, ip, nullptr);
+        if (inserted)
         {
             auto& new_cctx = registry_.create<otf2::definition::calling_context>(
-                intern_region(line_info), intern_scl(line_info), parent);
-            auto r = children.emplace(ip, new_cctx);
-            cctx_it = r.first;
+                intern_region(line_info), intern_scl(line_info), *tree.value(parent));
+            tree.value(node) = &new_cctx;
 
-            if (config().disassemble && infos.count(process) == 1)
+            if (config().disassemble && resolver.has_maps())
             {
                 try
                 {
-                    auto instruction = infos.at(process).maps().lookup_instruction(ip);
+                    auto instruction = resolver.lookup_instruction(ip);
                     Log::trace() << "mapped " << ip << " to " << instruction;
 
                     registry_.create<otf2::definition::calling_context_property>(
@@ -656,82 +812,99 @@ void Trace::merge_ips(const IpRefMap& new_children, IpCctxMap& children,
                 }
             }
         }
-        auto& cctx = cctx_it->second.cctx;
-        mapping_table.at(local_ref) = cctx.ref();
-
-        merge_ips(local_children, cctx_it->second.children, mapping_table, cctx, infos, process);
+        merged.global_nodes[local.index] = node;
+        refs.mappings[local.ref] = tree.value(node)->ref();
     }
 }
 
-otf2::definition::mapping_table
-Trace::merge_calling_contexts(const std::map<Thread, ThreadCctxRefs>& new_ips, size_t num_ip_refs,
-                              const std::map<Process, ProcessInfo>& infos)
+void Trace::start_cctx_merger(const std::map<Process, ProcessInfo>& process_infos,
+                              std::mutex& process_infos_mutex)
 {
-    std::lock_guard<std::recursive_mutex> guard(mutex_);
-#ifndef NDEBUG
-    std::vector<uint32_t> mappings(num_ip_refs, -1u);
-#else
-    std::vector<uint32_t> mappings(num_ip_refs);
-#endif
+    cctx_merger_ = std::thread([this, &process_infos, &process_infos_mutex]() {
+        cctx_merger_main(process_infos, process_infos_mutex);
+    });
+}
 
-    // Merge local thread tree into global thread tree
-    for (auto& local_thread_cctx : new_ips)
+void Trace::hand_off_calling_contexts(ThreadCctxRefMap& refs, std::vector<CctxDelta> deltas)
+{
     {
+        std::lock_guard<std::mutex> guard(cctx_merge_mutex_);
+        for (auto& delta : deltas)
+        {
+            cctx_merge_queue_.emplace_back(&refs, std::move(delta));
+        }
+    }
+    cctx_merge_cv_.notify_one();
+}
 
-        auto thread = local_thread_cctx.first;
-        auto process = local_thread_cctx.second.process;
-
-        groups_.add_thread(thread, process);
-        auto local_ref = local_thread_cctx.second.entry.ref;
+void Trace::cctx_merger_main(const std::map<Process, ProcessInfo>& process_infos,
+                             std::mutex& process_infos_mutex)
+{
+    add_monitoring_thread(gettid(), "CctxMerger", "CctxMerger");
 
-        auto global_thread_cctx = calling_context_tree_.find(thread);
+    while (true)
+    {
+        std::vector<std::pair<ThreadCctxRefMap*, CctxDelta>> deltas;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(cctx_merge_mutex_);
+            cctx_merge_cv_.wait(lock, [this]() {
+                return cctx_merger_stop_ || !cctx_merge_queue_.empty();
+            });
+            deltas.swap(cctx_merge_queue_);
+            stop = cctx_merger_stop_;
+        }
 
-        if (global_thread_cctx == calling_context_tree_.end())
+        // Memory maps change during the measurement, so every round takes new snapshots
+        std::map<Process, IpResolver> resolvers;
         {
-            if (thread != Thread(0))
+            std::lock_guard<std::mutex> guard(process_infos_mutex);
+            for (const auto& delta : deltas)
             {
+                resolvers.try_emplace(delta.second.process, process_infos, delta.second.process);
+            }
+        }
 
-                if (auto thread_name = thread_names_.find(thread);
-                    thread_name != thread_names_.end())
-                {
-                    add_thread(thread, thread_name->second);
-                }
-                else
+        std::size_t num_nodes = 0;
+        for (auto& delta : deltas)
+        {
+            prepend_pending(*delta.first, delta.second);
+            num_nodes += delta.second.nodes.size();
+
+            // Resolve before merging, which blocks the writers from creating definitions
+            auto& resolver = resolvers.at(delta.second.process);
+            for (const auto& node : delta.second.nodes)
+            {
+                if (node.index != IpRefTree::ROOT && resolver.is_mapped(node.ip))
                 {
-                    if (auto process_name = thread_names_.find(process.as_thread());
-                        process_name != thread_names_.end())
-                    {
-                        add_thread(thread, process_name->second);
-                    }
-                    else
-                    {
-                        add_thread(thread, "<unknown thread>");
-                    }
+                    resolver.lookup_line_info(node.ip);
                 }
             }
-            else
-            {
-                add_thread(thread, "<idle>");
-            }
-            global_thread_cctx = calling_context_tree_.find(thread);
+            merge_cctx_delta(*delta.first, delta.second, resolver, false);
         }
+        Log::debug() << "merged " << num_nodes << " calling contexts of " << deltas.size()
+                     << " thread(s) in the background";
 
-        assert(global_thread_cctx != calling_context_tree_.end());
-        mappings.at(local_ref) = global_thread_cctx->second.cctx.ref();
-
-        merge_ips(local_thread_cctx.second.entry.children, global_thread_cctx->second.children,
-                  mappings, global_thread_cctx->second.cctx, infos, process);
+        if (stop)
+        {
+            return;
+        }
     }
+}
 
-#ifndef NDEBUG
-    for (auto id : mappings)
+void Trace::stop_cctx_merger()
+{
+    if (!cctx_merger_.joinable())
     {
-        assert(id != -1u);
+        return;
     }
-#endif
 
-    return otf2::definition::mapping_table(
-        otf2::definition::mapping_table::mapping_type_type::calling_context, mappings);
+    {
+        std::lock_guard<std::mutex> guard(cctx_merge_mutex_);
+        cctx_merger_stop_ = true;
+    }
+    cctx_merge_cv_.notify_one();
+    cctx_merger_.join();
 }
 
 otf2::definition::mapping_table
@@ -786,8 +959,7 @@ void Trace::add_thread_exclusive(Thread thread, const std::string& name,
     auto& thread_cctx = registry_.create<otf2::definition::calling_context>(
         ByThread(thread), thread_region, otf2::definition::source_code_location());
 
-    calling_context_tree_.emplace(std::piecewise_construct, std::forward_as_tuple(thread),
-                                  std::forward_as_tuple(thread_cctx));
+    calling_context_tree_.emplace(thread, &thread_cctx);
 }
 
 void Trace::add_thread(Thread thread, const std::string& name)
@@ -817,8 +989,7 @@ void Trace::add_monitoring_thread(Thread thread, const std::string& name, const
 
         auto& lo2s_cctx = registry_.create<otf2::definition::calling_context>(
             ByThread(thread), ret, otf2::definition::source_code_location());
-        calling_context_tree_.emplace(std::piecewise_construct, std::forward_as_tuple(thread),
-                                      std::forward_as_tuple(lo2s_cctx));
+        calling_context_tree_.emplace(thread, &lo2s_cctx);
     }
 }
 
@@ -884,16 +1055,61 @@ ThreadCctxRefMap& Trace::create_cctx_refs()
 
 void Trace::merge_calling_contexts(const std::map<Process, ProcessInfo>& process_infos)
 {
+    auto start = std::chrono::steady_clock::now();
+
+    // Whatever was handed off is merged before the rest
+    stop_cctx_merger();
+
+    // The writers are done, so the remaining nodes can be taken directly
+    std::vector<std::pair<ThreadCctxRefMap*, CctxDelta>> deltas;
     for (auto& cctx : cctx_refs_)
     {
         assert(cctx.writer != nullptr);
+        for (auto& thread_cctx : cctx.map)
+        {
+            auto& delta =
+                deltas.emplace_back(&cctx, thread_cctx.second.take_delta(thread_cctx.first));
+            prepend_pending(cctx, delta.second);
+        }
+    }
+
+    // Shared by all writers, so that every memory map is copied and every IP resolved only once
+    std::map<Process, IpResolver> resolvers;
+    resolve_ips(deltas, process_infos, resolvers);
+
+    // With all IPs resolved, the merge only creates the definitions in a fixed order, so the
+    // references do not depend on the scheduling of the resolver threads
+    for (auto& delta : deltas)
+    {
+        merge_cctx_delta(*delta.first, delta.second, resolvers.at(delta.second.process), true);
+    }
+
+    for (auto& cctx : cctx_refs_)
+    {
         if (cctx.ref_count > 0)
         {
-            const auto& mapping = merge_calling_contexts(cctx.map, cctx.ref_count, process_infos);
-            (*cctx.writer) << mapping;
+            cctx.mappings.resize(cctx.ref_count, -1u);
+#ifndef NDEBUG
+            for (auto id : cctx.mappings)
+            {
+                assert(id != -1u);
+            }
+#endif
+            (*cctx.writer) << otf2::definition::mapping_table(
+                otf2::definition::mapping_table::mapping_type_type::calling_context,
+                cctx.mappings);
         }
     }
     cctx_refs_.clear();
+
+    SymbolCache::instance().flush();
+
+    if (config().defer_symbols)
+    {
+        DeferredSymbols::instance().write(trace_name_);
+    }
+
+    summary().record_cctx_merge(std::chrono::steady_clock::now() - start);
     auto finalized_twice = cctx_refs_finalized_.exchange(true);
     if (finalized_twice)
     {
@@ -170,59 +170,73 @@ const struct ::utsname& get_uname()
     return instance.uname;
 }
 
-std::unordered_map<Thread, std::string> get_comms_for_running_threads()
+std::vector<Process> get_running_processes()
 {
-    ExecutionScopeGroup& scope_group = ExecutionScopeGroup::instance();
-    std::unordered_map<Thread, std::string> ret;
-    std::filesystem::path proc("/proc");
-    for (auto& entry : std::filesystem::directory_iterator(proc))
+    std::vector<Process> processes;
+    for (auto& entry : std::filesystem::directory_iterator("/proc"))
     {
-        Process process;
         try
         {
-            process = Process(std::stoi(entry.path().filename().string()));
+            processes.emplace_back(std::stoi(entry.path().filename().string()));
         }
         catch (const std::logic_error&)
         {
             continue;
         }
-        std::string name = get_process_comm(process);
+    }
+    return processes;
+}
 
-        scope_group.add_process(process);
+std::unordered_map<Thread, std::string> get_comms_for_process(Process process)
+{
+    ExecutionScopeGroup& scope_group = ExecutionScopeGroup::instance();
+    std::unordered_map<Thread, std::string> ret;
+    std::string name = get_process_comm(process);
 
-        Log::trace() << "mapping from /proc/" << process.as_pid_t() << ": " << name;
-        ret.emplace(process.as_thread(), name);
-        try
+    scope_group.add_process(process);
+
+    Log::trace() << "mapping from /proc/" << process.as_pid_t() << ": " << name;
+    ret.emplace(process.as_thread(), name);
+    try
+    {
+        std::filesystem::path task(fmt::format("/proc/{}/task", process.as_pid_t()));
+        for (auto& entry_task : std::filesystem::directory_iterator(task))
         {
-            std::filesystem::path task(fmt::format("/proc/{}/task", process.as_pid_t()));
-            for (auto& entry_task : std::filesystem::directory_iterator(task))
+            Thread thread;
+            try
             {
-                Thread thread;
-                try
-                {
-                    thread = Thread(std::stoi(entry_task.path().filename().string()));
-                }
-                catch (const std::logic_error&)
-                {
-                    continue;
-                }
-                if (thread == process.as_thread())
-                {
-                    continue;
-                }
+                thread = Thread(std::stoi(entry_task.path().filename().string()));
+            }
+            catch (const std::logic_error&)
+            {
+                continue;
+            }
+            if (thread == process.as_thread())
+            {
+                continue;
+            }
 
-                scope_group.add_thread(thread, process);
+            scope_group.add_thread(thread, process);
 
-                name = get_task_comm(process, thread);
-                Log::trace() << "mapping from /proc/" << process.as_pid_t() << "/"
-                             << thread.as_pid_t() << ": " << name;
-                ret.emplace(thread, name);
-            }
-        }
-        catch (...)
-        {
+            name = get_task_comm(process, thread);
+            Log::trace() << "mapping from /proc/" << process.as_pid_t() << "/" << thread.as_pid_t()
+                         << ": " << name;
+            ret.emplace(thread, name);
         }
     }
+    catch (...)
+    {
+    }
+    return ret;
+}
+
+std::unordered_map<Thread, std::string> get_comms_for_running_threads()
+{
+    std::unordered_map<Thread, std::string> ret;
+    for (auto process : get_running_processes())
+    {
+        ret.merge(get_comms_for_process(process));
+    }
     return ret;
 }
 
@@ -422,6 +436,10 @@ int timerfd_from_ns(std::chrono::nanoseconds duration)
     tspec.it_interval.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
     tspec.it_interval.tv_nsec = (duration % std::chrono::seconds(1)).count();
 
+    // Set initial expiration to lowest possible value, this together with TFD_TIMER_ABSTIME
+    // should synchronize our timers. Note that an all-zero it_value would disarm the timer.
+    tspec.it_value.tv_nsec = 1;
+
     timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
 
     if (timerfd == -1)